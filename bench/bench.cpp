@@ -0,0 +1,719 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2022 IkarusDeveloper. All rights reserved.
+//
+// This code is licensed under the MIT License (MIT).
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// proxy_ptr against std::shared_ptr/std::weak_ptr. The first case of every
+// group is the std baseline, the others report how many times faster than
+// it they are.
+//
+//   proxy_ptr_bench [--reps N] [--warmup N] [--threads N] [--filter TEXT]
+//                   [--json FILE] [--csv FILE] [--quick]
+
+#include <proxy_ptr/proxy_flat.h>
+#include <proxy_ptr/proxy_ptr.h>
+#include <proxy_ptr/proxy_ptr32.h>
+#include <proxy_ptr/proxy_vector.h>
+#include <proxy_ptr/proxy_algorithm.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+    struct object {
+        virtual ~object() = default;
+        int value = 1;
+    };
+
+    struct derived : object {
+        int extra = 2;
+    };
+
+    struct pooled : object {};
+
+    struct shared_parent : std::enable_shared_from_this<shared_parent> {
+        int value = 1;
+    };
+
+    struct proxy_parent : proxy::proxy_parent_base<proxy_parent> {
+        int value = 1;
+    };
+
+    struct proxy_intrusive : proxy::proxy_intrusive_base<proxy_intrusive> {
+        int value = 1;
+    };
+}  // namespace
+
+template <> struct proxy::proxy_use_pool<pooled> : std::true_type {};
+
+namespace {
+    using clock_type = std::chrono::steady_clock;
+
+    // keeps the value and everything it points to from being optimized away
+    template <class Type> inline void do_not_optimize(const Type& value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void* sink;
+        sink = &value;
+#endif
+    }
+
+    template <class Func> double timed(Func&& func) {
+        const auto start = clock_type::now();
+        func();
+        const auto elapsed = clock_type::now() - start;
+        return std::chrono::duration<double, std::nano>(elapsed).count();
+    }
+
+    // a case runs ops operations and returns the nanoseconds spent in the
+    // timed part, the setup stays out of the measure
+    using case_fn = std::function<double(size_t ops)>;
+
+    struct bench_case {
+        std::string group;
+        std::string name;
+        unsigned threads;
+        size_t ops;
+        case_fn run;
+    };
+
+    struct bench_result {
+        const bench_case* bench;
+        double min_ns;
+        double median_ns;
+        double mean_ns;
+        double speedup;
+    };
+
+    struct options {
+        size_t reps = 10;
+        size_t warmup = 2;
+        unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+        size_t scale = 1;
+        std::string filter;
+        std::string json;
+        std::string csv;
+    };
+
+    // copy
+    template <class Ptr> case_fn copy_case(Ptr root) {
+        return [root](size_t ops) {
+            return timed([&] {
+                for (size_t i = 0; i < ops; i++) {
+                    Ptr copy(root);
+                    do_not_optimize(copy);
+                }
+            });
+        };
+    }
+
+    // move there and back
+    template <class Ptr> case_fn move_case(Ptr root) {
+        return [root](size_t ops) {
+            Ptr first(root), second;
+            return timed([&] {
+                for (size_t i = 0; i < ops; i++) {
+                    second = std::move(first);
+                    do_not_optimize(second);
+                    first = std::move(second);
+                    do_not_optimize(first);
+                }
+            });
+        };
+    }
+
+    template <class Ptr, class Func> case_fn access_case(Ptr ptr, Func func) {
+        return [ptr, func](size_t ops) {
+            int sum = 0;
+            const double ns = timed([&] {
+                for (size_t i = 0; i < ops; i++) {
+                    do_not_optimize(ptr);
+                    sum += func(ptr);
+                }
+            });
+            do_not_optimize(sum);
+            return ns;
+        };
+    }
+
+    template <class Ptr, class Func> case_fn cast_case(Ptr ptr, Func func) {
+        return [ptr, func](size_t ops) {
+            return timed([&] {
+                for (size_t i = 0; i < ops; i++) {
+                    auto cast = func(ptr);
+                    do_not_optimize(cast);
+                }
+            });
+        };
+    }
+
+    // every op creates an object and destroys it
+    template <class Func> case_fn make_case(Func func) {
+        return [func](size_t ops) {
+            return timed([&] {
+                for (size_t i = 0; i < ops; i++) {
+                    auto ptr = func();
+                    do_not_optimize(ptr);
+                }
+            });
+        };
+    }
+
+    template <class Ptr, class Func> case_fn from_this_case(Func func) {
+        return [func](size_t ops) {
+            auto owner = func();
+            return timed([&] {
+                for (size_t i = 0; i < ops; i++) {
+                    Ptr ptr = owner->proxy_from_this();
+                    do_not_optimize(ptr);
+                }
+            });
+        };
+    }
+
+    constexpr size_t container_size = 4096;
+
+    template <class Func> auto make_keys(Func func) {
+        std::vector<decltype(func())> keys;
+        keys.reserve(container_size);
+        for (size_t i = 0; i < container_size; i++)
+            keys.push_back(func());
+        return keys;
+    }
+
+    // op: one insert into an empty container growing to container_size
+    template <class Set, class Ptr> case_fn insert_case(std::vector<Ptr> keys) {
+        return [keys](size_t ops) {
+            double ns = 0;
+            for (size_t done = 0; done < ops; done += keys.size()) {
+                Set set;
+                const size_t count = std::min(keys.size(), ops - done);
+                ns += timed([&] {
+                    for (size_t i = 0; i < count; i++)
+                        set.insert(keys[i]);
+                });
+                do_not_optimize(set);
+            }
+            return ns;
+        };
+    }
+
+    // op: one successful lookup, the keys are visited in a shuffled order
+    template <class Set, class Ptr> case_fn find_case(std::vector<Ptr> keys) {
+        return [keys](size_t ops) {
+            Set set;
+            for (auto& key : keys)
+                set.insert(key);
+            std::vector<Ptr> order(keys);
+            std::shuffle(order.begin(), order.end(), std::mt19937(42));
+
+            const size_t mask = order.size() - 1;
+            size_t found = 0;
+            const double ns = timed([&] {
+                for (size_t i = 0; i < ops; i++)
+                    found += set.find(order[i & mask]) != set.end();
+            });
+            do_not_optimize(found);
+            return ns;
+        };
+    }
+
+    template <class Type> void expire(std::shared_ptr<Type>& ptr) {
+        ptr = nullptr;
+    }
+    template <class Ptr> void expire(Ptr& ptr) { ptr.proxy_delete(); }
+
+    // op: one alive check while walking a list of proxies, the list is
+    // bigger than the caches and every fourth object is expired
+    template <class Func> case_fn walk_case(Func make) {
+        return [make](size_t ops) {
+            constexpr size_t count = size_t(1) << 18;
+            auto list = make(count);
+            for (size_t i = 0; i < count; i += 4)
+                expire(list.owners[i]);
+            size_t alive = 0;
+            const double ns = timed([&] {
+                for (size_t i = 0; i < ops; i++)
+                    alive += !list.proxies[i & (count - 1)].expired();
+            });
+            do_not_optimize(alive);
+            return ns;
+        };
+    }
+
+    template <class Owner, class Proxy> struct walk_list {
+        std::vector<Owner> owners;
+        std::vector<Proxy> proxies;
+    };
+
+    // the objects are created in a shuffled order, as they would be after
+    // a while in a long running program
+    template <class Owner, class Proxy, class Func>
+    walk_list<Owner, Proxy> make_walk_list(size_t count, Func make) {
+        walk_list<Owner, Proxy> list;
+        list.owners.resize(count);
+        std::vector<size_t> order(count);
+        for (size_t i = 0; i < count; i++)
+            order[i] = i;
+        std::shuffle(order.begin(), order.end(), std::mt19937(7));
+        for (auto i : order)
+            list.owners[i] = make();
+        for (auto& owner : list.owners)
+            list.proxies.push_back(owner);
+        return list;
+    }
+
+    // op: one proxy of the list of walk_case checked by count_alive(),
+    // which prefetches the control blocks distance proxies ahead
+    case_fn count_alive_case(size_t distance) {
+        return [distance](size_t ops) {
+            constexpr size_t count = size_t(1) << 18;
+            auto list = make_walk_list<proxy::proxy_ptr<derived>,
+                                       proxy::proxy_ptr<derived>>(
+                count, [] { return proxy::make_proxy<derived>(); });
+            for (size_t i = 0; i < count; i += 4)
+                expire(list.owners[i]);
+            size_t alive = 0;
+            const double ns = timed([&] {
+                for (size_t done = 0; done < ops; done += count) {
+                    const auto end = list.proxies.begin() +
+                                     std::min(count, ops - done);
+                    alive += proxy::count_alive(list.proxies.begin(), end,
+                                                {distance});
+                }
+            });
+            do_not_optimize(alive);
+            return ns;
+        };
+    }
+
+    // op: one slot of a compaction, a list of 2^16 proxies with every
+    // fourth object expired is rebuilt and prepared out of the measure for
+    // each round
+    template <class List, class Prepare, class Func>
+    case_fn compact_case(Prepare prepare, Func compact) {
+        return [prepare, compact](size_t ops) {
+            const size_t count = std::min(size_t(1) << 16, ops);
+            auto source = make_walk_list<proxy::proxy_ptr<derived>,
+                                         proxy::proxy_ptr<derived>>(
+                count, [] { return proxy::make_proxy<derived>(); });
+            for (size_t i = 0; i < count; i += 4)
+                expire(source.owners[i]);
+
+            double ns = 0;
+            for (size_t done = 0; done < ops; done += count) {
+                List list;
+                for (auto& proxy : source.proxies)
+                    list.push_back(proxy);
+                prepare(list);
+                ns += timed([&] { compact(list); });
+                do_not_optimize(list);
+            }
+            return ns;
+        };
+    }
+
+    // every thread runs ops operations on the same object, ns/op is the
+    // wall time divided by the ops of a single thread
+    template <class Ptr, class Func>
+    case_fn contention_case(Ptr root, unsigned threads, Func func) {
+        return [root, threads, func](size_t ops) {
+            std::atomic<unsigned> ready{0};
+            std::atomic<bool> go{false};
+            std::vector<std::thread> workers;
+            for (unsigned t = 0; t < threads; t++) {
+                workers.emplace_back([&] {
+                    ready++;
+                    while (!go.load(std::memory_order_acquire))
+                        std::this_thread::yield();
+                    for (size_t i = 0; i < ops; i++)
+                        func(root);
+                });
+            }
+            while (ready.load() != threads)
+                std::this_thread::yield();
+
+            return timed([&] {
+                go.store(true, std::memory_order_release);
+                for (auto& worker : workers)
+                    worker.join();
+            });
+        };
+    }
+
+    std::vector<bench_case> make_cases(const options& opt) {
+        constexpr size_t fast_ops = size_t(1) << 22;
+        constexpr size_t slow_ops = size_t(1) << 18;
+        constexpr size_t thread_ops = size_t(1) << 20;
+
+        std::vector<bench_case> cases;
+        auto add = [&](const char* group, const char* name, size_t ops,
+                       case_fn run, unsigned threads = 1) {
+            cases.push_back({group, name, threads,
+                             std::max<size_t>(ops / opt.scale, 64),
+                             std::move(run)});
+        };
+
+        auto shared = std::make_shared<derived>();
+        std::weak_ptr<derived> weak = shared;
+        auto nonatomic = proxy::make_proxy<derived>();
+        auto atomic = proxy::make_proxy_atomic<derived>();
+        auto biased = proxy::make_proxy_biased<derived>();
+        proxy::proxy_ref<derived> ref = nonatomic;
+
+        add("copy", "shared_ptr", fast_ops, copy_case(shared));
+        add("copy", "weak_ptr", fast_ops, copy_case(weak));
+        add("copy", "proxy_ptr", fast_ops, copy_case(nonatomic));
+        add("copy", "proxy_ptr atomic", fast_ops, copy_case(atomic));
+        add("copy", "proxy_ptr biased", fast_ops, copy_case(biased));
+        add("copy", "proxy_ref", fast_ops, copy_case(ref));
+
+        add("move", "shared_ptr", fast_ops, move_case(shared));
+        add("move", "proxy_ptr", fast_ops, move_case(nonatomic));
+        add("move", "proxy_ptr atomic", fast_ops, move_case(atomic));
+
+        auto lock_get = [](auto& ptr) {
+            auto locked = ptr.lock();
+            return locked ? locked->value : 0;
+        };
+        auto checked_get = [](auto& ptr) {
+            auto raw = ptr.get();
+            return raw ? raw->value : 0;
+        };
+        add("access", "weak_ptr lock()->", fast_ops,
+            access_case(weak, lock_get));
+        add("access", "weak_ptr expired()", fast_ops,
+            access_case(weak, [](auto& ptr) { return int(!ptr.expired()); }));
+        add("access", "proxy_ptr alive()", fast_ops,
+            access_case(nonatomic,
+                        [](auto& ptr) { return int(ptr.alive()); }));
+        add("access", "proxy_ptr get()->", fast_ops,
+            access_case(nonatomic, checked_get));
+        add("access", "proxy_ptr atomic get()->", fast_ops,
+            access_case(atomic, checked_get));
+        add("access", "proxy_ptr atomic pin()->", fast_ops,
+            access_case(atomic, lock_get));
+        add("access", "proxy_ref get()->", fast_ops,
+            access_case(ref, checked_get));
+        // validated once, the guard keeps the object around
+        auto unchecked = access_case(
+            nonatomic, [](auto& ptr) { return ptr.get_unchecked()->value; });
+        add("access", "guarded get_unchecked()->", fast_ops,
+            [unchecked](size_t ops) {
+                proxy::deletion_guard guard;
+                return unchecked(ops);
+            });
+
+        std::shared_ptr<object> shared_base = shared;
+        proxy::proxy_ptr<object> proxy_base =
+            proxy::static_pointer_cast<object>(nonatomic);
+        add("static cast", "shared_ptr", fast_ops,
+            cast_case(shared, [](auto& ptr) {
+                return std::static_pointer_cast<object>(ptr);
+            }));
+        add("static cast", "proxy_ptr", fast_ops,
+            cast_case(nonatomic, [](auto& ptr) {
+                return proxy::static_pointer_cast<object>(ptr);
+            }));
+        add("dynamic cast", "shared_ptr", fast_ops,
+            cast_case(shared_base, [](auto& ptr) {
+                return std::dynamic_pointer_cast<derived>(ptr);
+            }));
+        add("dynamic cast", "proxy_ptr", fast_ops,
+            cast_case(proxy_base, [](auto& ptr) {
+                return proxy::dynamic_pointer_cast<derived>(ptr);
+            }));
+
+        add("make", "make_shared", slow_ops,
+            make_case([] { return std::make_shared<derived>(); }));
+        add("make", "shared_ptr(new)", slow_ops,
+            make_case([] { return std::shared_ptr<derived>(new derived); }));
+        add("make", "make_proxy", slow_ops,
+            make_case([] { return proxy::make_proxy<derived>(); }));
+        add("make", "proxy_ptr(new)", slow_ops, make_case([] {
+                return proxy::proxy_ptr<derived>(new derived);
+            }));
+        add("make", "make_proxy pooled", slow_ops,
+            make_case([] { return proxy::make_proxy<pooled>(); }));
+        add("make", "make_proxy atomic", slow_ops,
+            make_case([] { return proxy::make_proxy_atomic<derived>(); }));
+        add("make", "make_proxy biased", slow_ops,
+            make_case([] { return proxy::make_proxy_biased<derived>(); }));
+
+        add("from this", "shared_from_this", fast_ops, [](size_t ops) {
+            auto owner = std::make_shared<shared_parent>();
+            return timed([&] {
+                for (size_t i = 0; i < ops; i++) {
+                    auto ptr = owner->shared_from_this();
+                    do_not_optimize(ptr);
+                }
+            });
+        });
+        add("from this", "weak_from_this", fast_ops, [](size_t ops) {
+            auto owner = std::make_shared<shared_parent>();
+            return timed([&] {
+                for (size_t i = 0; i < ops; i++) {
+                    auto ptr = owner->weak_from_this();
+                    do_not_optimize(ptr);
+                }
+            });
+        });
+        add("from this", "proxy_parent_base", fast_ops,
+            from_this_case<proxy::proxy_ptr<proxy_parent>>(
+                [] { return std::make_unique<proxy_parent>(); }));
+        add("from this", "proxy_intrusive_base", fast_ops,
+            from_this_case<proxy::proxy_ptr<proxy_intrusive>>(
+                [] { return std::make_unique<proxy_intrusive>(); }));
+
+        using shared_set = std::unordered_set<std::shared_ptr<derived>>;
+        using proxy_set =
+            std::unordered_set<proxy::proxy_ptr<derived>, proxy::proxy_hash,
+                               proxy::proxy_equal>;
+        using flat_set = proxy::proxy_flat_set<derived>;
+        auto shared_keys =
+            make_keys([] { return std::make_shared<derived>(); });
+        auto proxy_keys =
+            make_keys([] { return proxy::make_proxy<derived>(); });
+        add("insert", "unordered_set<shared_ptr>", slow_ops,
+            insert_case<shared_set>(shared_keys));
+        add("insert", "unordered_set<proxy_ptr>", slow_ops,
+            insert_case<proxy_set>(proxy_keys));
+        add("insert", "proxy_flat_set", slow_ops,
+            insert_case<flat_set>(proxy_keys));
+        add("find", "unordered_set<shared_ptr>", fast_ops,
+            find_case<shared_set>(shared_keys));
+        add("find", "unordered_set<proxy_ptr>", fast_ops,
+            find_case<proxy_set>(proxy_keys));
+        add("find", "proxy_flat_set", fast_ops,
+            find_case<flat_set>(proxy_keys));
+
+        add("walk", "vector<weak_ptr>", fast_ops, walk_case([](size_t count) {
+                return make_walk_list<std::shared_ptr<derived>,
+                                      std::weak_ptr<derived>>(
+                    count, [] { return std::make_shared<derived>(); });
+            }));
+        add("walk", "vector<proxy_ptr>", fast_ops, walk_case([](size_t count) {
+                return make_walk_list<proxy::proxy_ptr<derived>,
+                                      proxy::proxy_ptr<derived>>(
+                    count, [] { return proxy::make_proxy<derived>(); });
+            }));
+        add("walk", "vector<proxy_ptr32>", fast_ops,
+            walk_case([](size_t count) {
+                return make_walk_list<proxy::proxy_ptr32<derived>,
+                                      proxy::proxy_ptr32<derived>>(
+                    count, [] { return proxy::make_proxy32<derived>(); });
+            }));
+        add("walk", "count_alive() no prefetch", fast_ops,
+            count_alive_case(0));
+        add("walk", "count_alive()", fast_ops,
+            count_alive_case(PROXY_PTR_PREFETCH_DISTANCE));
+
+        using proxy_list = std::vector<proxy::proxy_ptr<derived>>;
+        using proxy_vector = proxy::proxy_vector<derived>;
+        auto no_prepare = [](auto&) {};
+        auto refresh = [](proxy_vector& list) { list.refresh(); };
+        auto erase_expired = [](proxy_vector& list) { list.erase_expired(); };
+        add("compact", "vector remove_if expired()", fast_ops,
+            compact_case<proxy_list>(no_prepare, [](proxy_list& list) {
+                list.erase(std::remove_if(list.begin(), list.end(),
+                                          [](auto& ptr) {
+                                              return ptr.expired();
+                                          }),
+                           list.end());
+            }));
+        add("compact", "proxy_vector refresh+erase", fast_ops,
+            compact_case<proxy_vector>(no_prepare, [](proxy_vector& list) {
+                list.refresh();
+                list.erase_expired();
+            }));
+        // the mirror was refreshed by the tick walking the list
+        add("compact", "proxy_vector erase_expired()", fast_ops,
+            compact_case<proxy_vector>(refresh, erase_expired));
+
+        auto copy = [](auto& root) {
+            auto ptr = root;
+            do_not_optimize(ptr);
+        };
+        auto pin = [](auto& root) {
+            auto guard = root.lock();
+            do_not_optimize(guard);
+        };
+        // powers of two, then the requested count
+        std::vector<unsigned> thread_counts;
+        for (unsigned threads = 1; threads < opt.threads; threads *= 2)
+            thread_counts.push_back(threads);
+        thread_counts.push_back(opt.threads);
+        for (auto threads : thread_counts) {
+            add("contended copy", "shared_ptr", thread_ops,
+                contention_case(shared, threads, copy), threads);
+            add("contended copy", "proxy_ptr atomic", thread_ops,
+                contention_case(atomic, threads, copy), threads);
+            add("contended copy", "proxy_ptr biased", thread_ops,
+                contention_case(biased, threads, copy), threads);
+            add("contended lock", "weak_ptr lock()", thread_ops,
+                contention_case(weak, threads, pin), threads);
+            add("contended lock", "proxy_ptr atomic pin()", thread_ops,
+                contention_case(atomic, threads, pin), threads);
+        }
+        return cases;
+    }
+
+    bench_result run_case(const bench_case& bench, const options& opt) {
+        for (size_t i = 0; i < opt.warmup; i++)
+            bench.run(bench.ops);
+
+        std::vector<double> samples;
+        for (size_t i = 0; i < opt.reps; i++)
+            samples.push_back(bench.run(bench.ops) / double(bench.ops));
+        std::sort(samples.begin(), samples.end());
+
+        double sum = 0;
+        for (auto sample : samples)
+            sum += sample;
+        // proxy_biased references released by the workers are settled here
+        proxy::proxy_biased_flush();
+        return {&bench, samples.front(), samples[samples.size() / 2],
+                sum / double(samples.size()), 1.0};
+    }
+
+    // the speedup of a case over the first case of its group with the same
+    // number of threads
+    void compute_speedups(std::vector<bench_result>& results) {
+        for (auto& result : results) {
+            for (auto& baseline : results) {
+                if (baseline.bench->group == result.bench->group &&
+                    baseline.bench->threads == result.bench->threads) {
+                    result.speedup = baseline.median_ns / result.median_ns;
+                    break;
+                }
+            }
+        }
+    }
+
+    void print_results(const std::vector<bench_result>& results) {
+        std::printf("%-16s %-28s %7s %10s %10s %10s %8s\n", "group", "case",
+                    "threads", "median ns", "min ns", "mean ns", "speedup");
+        const std::string* group = nullptr;
+        for (auto& result : results) {
+            if (group && *group != result.bench->group)
+                std::printf("\n");
+            group = &result.bench->group;
+            std::printf("%-16s %-28s %7u %10.2f %10.2f %10.2f %7.2fx\n",
+                        result.bench->group.c_str(),
+                        result.bench->name.c_str(), result.bench->threads,
+                        result.median_ns, result.min_ns, result.mean_ns,
+                        result.speedup);
+        }
+    }
+
+    void write_json(const std::string& path,
+                    const std::vector<bench_result>& results,
+                    const options& opt) {
+        std::ofstream out(path);
+        out << "{\n  \"reps\": " << opt.reps << ",\n  \"warmup\": "
+            << opt.warmup << ",\n  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            auto& result = results[i];
+            out << "    {\"group\": \"" << result.bench->group
+                << "\", \"case\": \"" << result.bench->name
+                << "\", \"threads\": " << result.bench->threads
+                << ", \"ops\": " << result.bench->ops
+                << ", \"median_ns\": " << result.median_ns
+                << ", \"min_ns\": " << result.min_ns
+                << ", \"mean_ns\": " << result.mean_ns
+                << ", \"speedup\": " << result.speedup << "}"
+                << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}\n";
+    }
+
+    void write_csv(const std::string& path,
+                   const std::vector<bench_result>& results) {
+        std::ofstream out(path);
+        out << "group,case,threads,ops,median_ns,min_ns,mean_ns,speedup\n";
+        for (auto& result : results) {
+            out << result.bench->group << ',' << result.bench->name << ','
+                << result.bench->threads << ',' << result.bench->ops << ','
+                << result.median_ns << ',' << result.min_ns << ','
+                << result.mean_ns << ',' << result.speedup << '\n';
+        }
+    }
+
+    bool parse_options(int argc, char** argv, options& opt) {
+        for (int i = 1; i < argc; i++) {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+            if (arg == "--quick") {
+                opt.scale = 64;
+                opt.reps = 3;
+                opt.warmup = 1;
+            } else if (arg == "--reps" && has_value) {
+                opt.reps = std::max(1, std::atoi(argv[++i]));
+            } else if (arg == "--warmup" && has_value) {
+                opt.warmup = std::max(0, std::atoi(argv[++i]));
+            } else if (arg == "--threads" && has_value) {
+                opt.threads = unsigned(std::max(1, std::atoi(argv[++i])));
+            } else if (arg == "--filter" && has_value) {
+                opt.filter = argv[++i];
+            } else if (arg == "--json" && has_value) {
+                opt.json = argv[++i];
+            } else if (arg == "--csv" && has_value) {
+                opt.csv = argv[++i];
+            } else {
+                std::fprintf(stderr,
+                             "usage: %s [--reps N] [--warmup N] [--threads N] "
+                             "[--filter TEXT] [--json FILE] [--csv FILE] "
+                             "[--quick]\n",
+                             argv[0]);
+                return false;
+            }
+        }
+        return true;
+    }
+}  // namespace
+
+int main(int argc, char** argv) {
+    options opt;
+    if (!parse_options(argc, argv, opt))
+        return 1;
+
+    const auto cases = make_cases(opt);
+    std::vector<bench_result> results;
+    for (auto& bench : cases) {
+        const auto label = bench.group + "/" + bench.name;
+        if (!opt.filter.empty() && label.find(opt.filter) == std::string::npos)
+            continue;
+        results.push_back(run_case(bench, opt));
+    }
+
+    compute_speedups(results);
+    print_results(results);
+    if (!opt.json.empty())
+        write_json(opt.json, results, opt);
+    if (!opt.csv.empty())
+        write_csv(opt.csv, results);
+    return 0;
+}
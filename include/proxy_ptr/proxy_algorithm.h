@@ -0,0 +1,294 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2022 IkarusDeveloper. All rights reserved.
+//
+// This code is licensed under the MIT License (MIT).
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef __PROXY_PROXY_ALGORITHM_H__
+    #define __PROXY_PROXY_ALGORITHM_H__
+
+    #include "proxy_ptr.h"
+    #include <algorithm>
+    #include <atomic>
+    #include <condition_variable>
+    #include <functional>
+    #include <iterator>
+    #include <mutex>
+    #include <thread>
+    #include <vector>
+    #if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        #include <xmmintrin.h>
+    #endif
+
+    // proxies a walk prefetches ahead of the one it checks
+    #ifndef PROXY_PTR_PREFETCH_DISTANCE
+        #define PROXY_PTR_PREFETCH_DISTANCE 8
+    #endif
+
+namespace proxy {
+    // how far ahead the algorithms prefetch: the control blocks, and the
+    // objects too if fn is going to touch them. A distance of 0 disables
+    // the prefetch.
+    struct proxy_prefetch {
+        size_t distance = PROXY_PTR_PREFETCH_DISTANCE;
+        bool objects = false;
+    };
+
+    namespace detail {
+        inline void _proxy_prefetch(const void* ptr) noexcept {
+    #if defined(__GNUC__) || defined(__clang__)
+            __builtin_prefetch(ptr);
+    #elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+            _mm_prefetch(static_cast<const char*>(ptr), _MM_HINT_T0);
+    #else
+            PROXY_PTR_UNUSED(ptr);
+    #endif
+        }
+
+        // the object pointer of a proxy_ptr doesn't depend on its block, so
+        // both loads are issued at once
+        template <class Proxy>
+        void _proxy_prefetch_target(const Proxy& ptr,
+                                    const proxy_prefetch& prefetch) {
+            _proxy_prefetch(ptr._state());
+            if (prefetch.objects)
+                _proxy_prefetch(ptr.hashkey());
+        }
+
+        // walks [first, last) keeping an iterator distance proxies ahead,
+        // whose targets are prefetched before visit(proxy) reaches them
+        template <class It, class Visit>
+        void _proxy_prefetch_walk(It first, It last,
+                                  const proxy_prefetch& prefetch,
+                                  Visit&& visit) {
+            It ahead = first;
+            for (size_t n = 0; n < prefetch.distance && ahead != last;
+                 n++, ++ahead)
+                _proxy_prefetch_target(*ahead, prefetch);
+
+            for (; first != last; ++first) {
+                if (ahead != last) {
+                    _proxy_prefetch_target(*ahead, prefetch);
+                    ++ahead;
+                }
+                visit(*first);
+            }
+        }
+
+        template <class It>
+        using _proxy_range_state = typename std::remove_pointer_t<decltype(
+            std::declval<typename std::iterator_traits<It>::reference>()
+                ._state())>;
+
+        template <class It>
+        constexpr bool _is_atomic_range =
+            std::is_same_v<_proxy_range_state<It>,
+                           _proxy_common_state_base<proxy_atomic>>;
+    }  // namespace detail
+
+    // fixed set of workers for the parallel algorithms, run() forks a job
+    // and waits for it, one job at a time
+    class proxy_thread_pool {
+       public:
+        // the calling thread of run() works too, threads counts it
+        explicit proxy_thread_pool(
+            unsigned threads = std::thread::hardware_concurrency()) {
+            for (unsigned i = 1; i < std::max(threads, 1u); i++)
+                _workers.emplace_back([this] { _work(); });
+        }
+        proxy_thread_pool(const proxy_thread_pool&) = delete;
+        proxy_thread_pool& operator=(const proxy_thread_pool&) = delete;
+
+        ~proxy_thread_pool() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _wake.notify_all();
+            for (auto& worker : _workers)
+                worker.join();
+        }
+
+        unsigned size() const noexcept {
+            return static_cast<unsigned>(_workers.size()) + 1;
+        }
+
+        // task(index) for every index in [0, count), it must not throw
+        void run(size_t count, const std::function<void(size_t)>& task) {
+            std::lock_guard<std::mutex> job_lock(_job_mutex);
+            {
+                // a worker late for the previous job may still be taking
+                std::unique_lock<std::mutex> lock(_mutex);
+                _finished.wait(lock, [this] { return _active == 0; });
+                _task = &task;
+                _count = count;
+                _next.store(0, std::memory_order_relaxed);
+                _done = 0;
+                _generation++;
+            }
+            _wake.notify_all();
+
+            const size_t done = _take(task, count);
+            std::unique_lock<std::mutex> lock(_mutex);
+            _done += done;
+            _finished.wait(lock, [this] { return _done == _count; });
+        }
+
+       private:
+        void _work() {
+            std::uint64_t seen = 0;
+            for (;;) {
+                const std::function<void(size_t)>* task;
+                size_t count;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _wake.wait(lock,
+                               [&] { return _stop || _generation != seen; });
+                    if (_stop)
+                        return;
+                    seen = _generation;
+                    if (_done == _count)
+                        continue;
+                    task = _task;
+                    count = _count;
+                    _active++;
+                }
+                const size_t done = _take(*task, count);
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _done += done;
+                    _active--;
+                }
+                _finished.notify_all();
+            }
+        }
+
+        // runs the indices nobody took yet, returns how many
+        size_t _take(const std::function<void(size_t)>& task, size_t count) {
+            size_t done = 0;
+            for (;;) {
+                const size_t index =
+                    _next.fetch_add(1, std::memory_order_relaxed);
+                if (index >= count)
+                    return done;
+                task(index);
+                done++;
+            }
+        }
+
+        std::vector<std::thread> _workers;
+        std::mutex _job_mutex;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::condition_variable _finished;
+        const std::function<void(size_t)>* _task = nullptr;
+        size_t _count = 0;
+        size_t _done = 0;
+        unsigned _active = 0;
+        std::atomic<size_t> _next{0};
+        std::uint64_t _generation = 0;
+        bool _stop = false;
+    };
+
+    // calls fn(object) for the proxies alive in [first, last), prefetching
+    // their blocks ahead. Like get(), it doesn't keep the objects from
+    // being deleted by other threads. Returns the number of calls.
+    template <class It, class Func>
+    size_t for_each_alive(It first, It last, Func&& fn,
+                          const proxy_prefetch& prefetch = {}) {
+        size_t count = 0;
+        detail::_proxy_prefetch_walk(first, last, prefetch,
+                                     [&](const auto& ptr) {
+                                         if (auto object = ptr.get()) {
+                                             fn(*object);
+                                             count++;
+                                         }
+                                     });
+        return count;
+    }
+
+    template <class It>
+    size_t count_alive(It first, It last,
+                       const proxy_prefetch& prefetch = {}) {
+        size_t count = 0;
+        detail::_proxy_prefetch_walk(
+            first, last, prefetch,
+            [&](const auto& ptr) { count += ptr.alive(); });
+        return count;
+    }
+
+    // moves the alive proxies in front keeping their order, returns the
+    // end of them: erase(partition_alive(...), end()) drops the expired
+    template <class It>
+    It partition_alive(It first, It last,
+                       const proxy_prefetch& prefetch = {}) {
+        It out = first;
+        detail::_proxy_prefetch_walk(first, last, prefetch,
+                                     [&](auto& ptr) {
+                                         if (!ptr.alive())
+                                             return;
+                                         if (&ptr != &*out)
+                                             std::swap(*out, ptr);
+                                         ++out;
+                                     });
+        return out;
+    }
+
+    // proxy_atomic ranges only: the range is split in chunks walked by
+    // the pool, and fn(object) runs concurrently while the object is
+    // pinned, so other threads can't delete it meanwhile
+    template <class It, class Func>
+    size_t for_each_alive(proxy_thread_pool& pool, It first, It last,
+                          Func&& fn, const proxy_prefetch& prefetch = {}) {
+        static_assert(detail::_is_atomic_range<It>,
+                      "the parallel algorithms need proxy_atomic proxies");
+        const size_t size = static_cast<size_t>(std::distance(first, last));
+        const size_t chunk =
+            std::max<size_t>(1024, size / (size_t(pool.size()) * 4) + 1);
+        std::atomic<size_t> count{0};
+        pool.run((size + chunk - 1) / chunk, [&](size_t index) {
+            auto begin = std::next(first, index * chunk);
+            auto end = std::next(begin, std::min(chunk, size - index * chunk));
+            size_t local = 0;
+            detail::_proxy_prefetch_walk(begin, end, prefetch,
+                                         [&](const auto& ptr) {
+                                             if (auto pin = ptr.pin()) {
+                                                 fn(*pin.get());
+                                                 local++;
+                                             }
+                                         });
+            count.fetch_add(local, std::memory_order_relaxed);
+        });
+        return count.load();
+    }
+
+    template <class It>
+    size_t count_alive(proxy_thread_pool& pool, It first, It last,
+                       const proxy_prefetch& prefetch = {}) {
+        static_assert(detail::_is_atomic_range<It>,
+                      "the parallel algorithms need proxy_atomic proxies");
+        const size_t size = static_cast<size_t>(std::distance(first, last));
+        const size_t chunk =
+            std::max<size_t>(1024, size / (size_t(pool.size()) * 4) + 1);
+        std::atomic<size_t> count{0};
+        pool.run((size + chunk - 1) / chunk, [&](size_t index) {
+            auto begin = std::next(first, index * chunk);
+            auto end = std::next(begin, std::min(chunk, size - index * chunk));
+            count.fetch_add(count_alive(begin, end, prefetch),
+                            std::memory_order_relaxed);
+        });
+        return count.load();
+    }
+}  // namespace proxy
+
+#endif
@@ -0,0 +1,203 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2022 IkarusDeveloper. All rights reserved.
+//
+// This code is licensed under the MIT License (MIT).
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef __PROXY_PROXY_DOMAIN_H__
+    #define __PROXY_PROXY_DOMAIN_H__
+
+    #include "proxy_ptr.h"
+    #include <mutex>
+
+namespace proxy {
+    template <class AtomicType = proxy_non_atomic> class proxy_domain;
+
+    namespace detail {
+        struct _proxy_domain_link {
+            _proxy_domain_link* prev = nullptr;
+            _proxy_domain_link* next = nullptr;
+
+            bool linked() const { return next != nullptr; }
+            void link_before(_proxy_domain_link* pos) {
+                prev = pos->prev;
+                next = pos;
+                prev->next = this;
+                pos->prev = this;
+            }
+            void unlink() {
+                prev->next = next;
+                next->prev = prev;
+                prev = next = nullptr;
+            }
+        };
+
+        // type-erased part of the domain states, linked in their domain
+        template <class AtomicType>
+        class _proxy_domain_node : public _proxy_domain_state_base<AtomicType>,
+                                   public _proxy_domain_link {
+           public:
+            using _proxy_domain_state_base<
+                AtomicType>::_proxy_domain_state_base;
+
+            proxy_domain<AtomicType>* _domain = nullptr;
+        };
+
+        template <class Type, class AtomicType>
+        class _proxy_domain_state
+            : public _proxy_inplace_state<Type, AtomicType,
+                                          _proxy_domain_node<AtomicType>> {
+           public:
+            using inplace_type =
+                _proxy_inplace_state<Type, AtomicType,
+                                     _proxy_domain_node<AtomicType>>;
+            using base_type = _proxy_common_state_base<AtomicType>;
+
+            template <class... args>
+            _proxy_domain_state(proxy_domain<AtomicType>& domain,
+                                args&&... va)
+                : inplace_type(&_destroy, _value_init_tag{},
+                               std::forward<args>(va)...) {
+                domain._attach(this);
+            }
+
+           private:
+            static void _destroy(base_type* base,
+                                 typename base_type::destroy_op op) {
+                if (op == base_type::destroy_op::state) {
+                    auto state = static_cast<_proxy_domain_state*>(base);
+                    if (state->_domain)
+                        state->_domain->_detach(state);
+                }
+                inplace_type::template _destroy<_proxy_domain_state>(base, op);
+            }
+        };
+    }  // namespace detail
+
+    // group of objects expired all at once: invalidate_all() bumps the
+    // domain generation, which every proxy of the group checks in alive(),
+    // and the deleters run later in sweep(), a batch at a time if needed.
+    // The domain must outlive the threads using its proxies.
+    template <class AtomicType> class proxy_domain {
+        static_assert(std::is_same_v<AtomicType, proxy_atomic> ||
+                          std::is_same_v<AtomicType, proxy_non_atomic>,
+                      "proxy_domain supports proxy_atomic and "
+                      "proxy_non_atomic");
+
+        static constexpr bool _is_atomic =
+            std::is_same_v<AtomicType, proxy_atomic>;
+        using node_type = detail::_proxy_domain_node<AtomicType>;
+        using mutex_type = std::conditional_t<_is_atomic, std::mutex,
+                                              detail::_proxy_null_mutex>;
+
+       public:
+        proxy_domain() {
+            _live.prev = _live.next = &_live;
+            _expired.prev = _expired.next = &_expired;
+        }
+        proxy_domain(const proxy_domain&) = delete;
+        proxy_domain& operator=(const proxy_domain&) = delete;
+
+        ~proxy_domain() {
+            invalidate_all();
+            sweep();
+        }
+
+        // like make_proxy, but the object belongs to the domain
+        template <class Ty, class... Args>
+        std::enable_if_t<!PROXY_PTR_IS_ARRAY(Ty), proxy_ptr<Ty, AtomicType>>
+        make(Args&&... Arguments) {
+            using common_ptr_type = detail::_proxy_domain_state<Ty, AtomicType>;
+            return detail::_proxy_access::make<proxy_ptr<Ty, AtomicType>>(
+                new common_ptr_type(*this, std::forward<Args>(Arguments)...));
+        }
+
+        // expires every proxy created so far, the deleters are left to
+        // sweep()
+        void invalidate_all() {
+            std::lock_guard<mutex_type> lock(_mutex);
+            if constexpr (_is_atomic)
+                _generation.fetch_add(1, std::memory_order_release);
+            else
+                _generation++;
+
+            if (_live.next == &_live)
+                return;
+            // splices the live list at the end of the expired one
+            _live.next->prev = _expired.prev;
+            _expired.prev->next = _live.next;
+            _live.prev->next = &_expired;
+            _expired.prev = _live.prev;
+            _live.prev = _live.next = &_live;
+        }
+
+        // runs the deleters of up to budget invalidated objects, returns
+        // the number of deleters run
+        size_t sweep(size_t budget = ~size_t(0)) {
+            size_t count = 0;
+            while (count < budget) {
+                node_type* node = nullptr;
+                {
+                    std::lock_guard<mutex_type> lock(_mutex);
+                    if (_expired.next == &_expired)
+                        break;
+                    node = static_cast<node_type*>(_expired.next);
+                    node->unlink();
+                    // its last proxy is already destroying it otherwise
+                    if (!node->try_inc_ref())
+                        continue;
+                    node->_domain = nullptr;
+                }
+
+                node->delete_ptr();
+                if (!node->dec_ref())
+                    node->destroy();
+                count++;
+            }
+            return count;
+        }
+
+        // invalidated objects whose deleter didn't run yet
+        PROXY_PTR_NO_DISCARD bool has_expired() const {
+            std::lock_guard<mutex_type> lock(_mutex);
+            return _expired.next != &_expired;
+        }
+
+       private:
+        template <class, class> friend class detail::_proxy_domain_state;
+
+        void _attach(node_type* node) {
+            std::lock_guard<mutex_type> lock(_mutex);
+            node->_domain = this;
+            node->_domain_generation = &_generation;
+            if constexpr (_is_atomic)
+                node->_generation = _generation.load(std::memory_order_relaxed);
+            else
+                node->_generation = _generation;
+            node->link_before(&_live);
+        }
+
+        void _detach(node_type* node) {
+            std::lock_guard<mutex_type> lock(_mutex);
+            if (node->linked())
+                node->unlink();
+        }
+
+        detail::deduce_ref_count_type<AtomicType> _generation{0};
+        detail::_proxy_domain_link _live;
+        detail::_proxy_domain_link _expired;
+        mutable mutex_type _mutex;
+    };
+}  // namespace proxy
+
+#endif
@@ -0,0 +1,267 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2022 IkarusDeveloper. All rights reserved.
+//
+// This code is licensed under the MIT License (MIT).
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef __PROXY_PROXY_EPOCH_H__
+    #define __PROXY_PROXY_EPOCH_H__
+
+    #include "proxy_ptr.h"
+    #include <mutex>
+    #include <vector>
+
+    // retired objects per thread before a collection is attempted
+    #ifndef PROXY_PTR_EPOCH_COLLECT_THRESHOLD
+        #define PROXY_PTR_EPOCH_COLLECT_THRESHOLD 64
+    #endif
+
+namespace proxy {
+    // epoch based reclamation: the readers announce the epoch they are
+    // reading in, and a retired object is reclaimed only once the global
+    // epoch moved two steps past the one it was retired in, so no reader can
+    // still be looking at it
+    class proxy_epoch_domain {
+        struct _thread_record;
+
+       public:
+        using reclaim_fn = void (*)(void*);
+
+        static proxy_epoch_domain& global() {
+            static proxy_epoch_domain domain;
+            return domain;
+        }
+
+        // reader critical section, it can be nested
+        class read_guard {
+           public:
+            explicit read_guard(proxy_epoch_domain& domain)
+                : _record(domain._enter()) {}
+            read_guard(const read_guard&) = delete;
+            read_guard& operator=(const read_guard&) = delete;
+            ~read_guard() { _record->exit(); }
+
+           private:
+            _thread_record* _record;
+        };
+
+        PROXY_PTR_NO_DISCARD read_guard read() { return read_guard(*this); }
+
+        // reclaim(ptr) is called once no reader can reach ptr anymore
+        void retire(void* ptr, reclaim_fn reclaim) {
+            auto& record = _local();
+            record.limbo.push_back(
+                {ptr, reclaim, _epoch.load(std::memory_order_seq_cst)});
+            if (record.limbo.size() >= PROXY_PTR_EPOCH_COLLECT_THRESHOLD)
+                collect();
+        }
+
+        // reclaims what the calling thread (or the exited ones) retired,
+        // returns the number of reclaimed objects
+        size_t collect() {
+            _try_advance();
+            const auto epoch = _epoch.load(std::memory_order_acquire);
+
+            size_t count = _reclaim(_local().limbo, epoch);
+            std::vector<_retired> orphans;
+            {
+                std::lock_guard<std::mutex> lock(_orphans_mutex);
+                orphans.swap(_orphans);
+            }
+            if (!orphans.empty()) {
+                count += _reclaim(orphans, epoch);
+                std::lock_guard<std::mutex> lock(_orphans_mutex);
+                _orphans.insert(_orphans.end(), orphans.begin(), orphans.end());
+            }
+            return count;
+        }
+
+        // objects retired by the calling thread and not reclaimed yet
+        size_t pending() { return _local().limbo.size(); }
+
+        ~proxy_epoch_domain() {
+            // no reader can be around anymore
+            _epoch.fetch_add(2);
+            const auto epoch = _epoch.load();
+            while (_reclaim(_orphans, epoch))
+                ;
+            for (auto record = _records.load(); record;)
+                delete std::exchange(record, record->next);
+        }
+
+       private:
+        struct _retired {
+            void* ptr;
+            reclaim_fn reclaim;
+            std::uint64_t epoch;
+        };
+
+        static constexpr std::uint64_t _quiescent = ~std::uint64_t(0);
+
+        // never freed before the domain, reused once its thread exits
+        struct _thread_record {
+            std::atomic<std::uint64_t> epoch{_quiescent};
+            std::atomic<bool> in_use{true};
+            _thread_record* next = nullptr;
+            proxy_epoch_domain* domain = nullptr;
+            size_t nesting = 0;
+            std::vector<_retired> limbo;
+
+            void exit() {
+                if (--nesting == 0)
+                    epoch.store(_quiescent, std::memory_order_release);
+            }
+        };
+
+        struct _thread_holder {
+            _thread_record* record = nullptr;
+            ~_thread_holder() {
+                if (record)
+                    record->domain->_release(record);
+            }
+        };
+
+        proxy_epoch_domain() = default;
+
+        _thread_record* _enter() {
+            auto& record = _local();
+            if (record.nesting++ == 0) {
+                record.epoch.store(_epoch.load(std::memory_order_relaxed),
+                                   std::memory_order_seq_cst);
+            }
+            return &record;
+        }
+
+        _thread_record& _local() {
+            thread_local _thread_holder holder;
+            if (!holder.record)
+                holder.record = _acquire();
+            return *holder.record;
+        }
+
+        _thread_record* _acquire() {
+            for (auto record = _records.load(); record; record = record->next) {
+                bool expected = false;
+                if (!record->in_use.load(std::memory_order_relaxed) &&
+                    record->in_use.compare_exchange_strong(expected, true))
+                    return record;
+            }
+
+            auto record = new _thread_record;
+            record->domain = this;
+            record->next = _records.load(std::memory_order_relaxed);
+            while (!_records.compare_exchange_weak(record->next, record))
+                ;
+            return record;
+        }
+
+        void _release(_thread_record* record) {
+            if (!record->limbo.empty()) {
+                std::lock_guard<std::mutex> lock(_orphans_mutex);
+                _orphans.insert(_orphans.end(), record->limbo.begin(),
+                                record->limbo.end());
+                record->limbo.clear();
+            }
+            record->nesting = 0;
+            record->epoch.store(_quiescent, std::memory_order_release);
+            record->in_use.store(false, std::memory_order_release);
+        }
+
+        // the epoch moves on only when every reader has seen the current one
+        void _try_advance() {
+            auto epoch = _epoch.load(std::memory_order_seq_cst);
+            for (auto record = _records.load(std::memory_order_acquire); record;
+                 record = record->next) {
+                const auto local =
+                    record->epoch.load(std::memory_order_seq_cst);
+                if (local != _quiescent && local != epoch)
+                    return;
+            }
+            _epoch.compare_exchange_strong(epoch, epoch + 1,
+                                           std::memory_order_seq_cst);
+        }
+
+        // the reclaim functions may retire again, so the ready entries are
+        // moved out of the list before they run
+        static size_t _reclaim(std::vector<_retired>& list,
+                               std::uint64_t epoch) {
+            std::vector<_retired> ready;
+            auto keep = list.begin();
+            for (auto it = list.begin(); it != list.end(); ++it) {
+                if (it->epoch + 2 <= epoch)
+                    ready.push_back(*it);
+                else
+                    *keep++ = *it;
+            }
+            list.erase(keep, list.end());
+
+            for (auto& retired : ready)
+                retired.reclaim(retired.ptr);
+            return ready.size();
+        }
+
+        std::atomic<std::uint64_t> _epoch{0};
+        std::atomic<_thread_record*> _records{nullptr};
+        std::mutex _orphans_mutex;
+        std::vector<_retired> _orphans;
+    };
+
+    namespace detail {
+        // make_proxy state whose deleter waits for the epoch readers
+        template <class Type>
+        class _proxy_epoch_state
+            : public _proxy_inplace_state<Type, proxy_atomic> {
+           public:
+            using inplace_type = _proxy_inplace_state<Type, proxy_atomic>;
+            using base_type = _proxy_common_state_base<proxy_atomic>;
+
+            template <class... args>
+            _proxy_epoch_state(args&&... va)
+                : inplace_type(&_defer, _value_init_tag{},
+                               std::forward<args>(va)...) {}
+
+           private:
+            static void _defer(base_type* base,
+                               typename base_type::destroy_op op) {
+                if (op != base_type::destroy_op::object)
+                    return inplace_type::template _destroy<_proxy_epoch_state>(
+                        base, op);
+
+                // the domain keeps a reference until the object is reclaimed
+                base->inc_ref();
+                proxy_epoch_domain::global().retire(base, &_reclaim);
+            }
+
+            static void _reclaim(void* ptr) {
+                auto base = static_cast<base_type*>(ptr);
+                inplace_type::template _destroy<_proxy_epoch_state>(
+                    base, base_type::destroy_op::object);
+                if (!base->dec_ref())
+                    base->destroy();
+            }
+        };
+    }  // namespace detail
+
+    // like make_proxy_atomic, but after proxy_delete() the object is only
+    // destroyed once every proxy_epoch_domain reader has moved on, so the
+    // readers can use get() without copying or pinning the proxy
+    template <class Ty, class... Args>
+    std::enable_if_t<!PROXY_PTR_IS_ARRAY(Ty), proxy_ptr<Ty, proxy_atomic>>
+    make_proxy_epoch(Args&&... Arguments) {
+        using common_ptr_type = detail::_proxy_epoch_state<Ty>;
+        return detail::_proxy_access::make<proxy_ptr<Ty, proxy_atomic>>(
+            new common_ptr_type(std::forward<Args>(Arguments)...));
+    }
+}  // namespace proxy
+
+#endif
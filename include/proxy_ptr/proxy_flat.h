@@ -0,0 +1,437 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2022 IkarusDeveloper. All rights reserved.
+//
+// This code is licensed under the MIT License (MIT).
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef __PROXY_PROXY_FLAT_H__
+    #define __PROXY_PROXY_FLAT_H__
+
+    #include "proxy_ptr.h"
+    #include <algorithm>
+    #include <iterator>
+    #include <memory>
+    #include <stdexcept>
+    #include <tuple>
+
+namespace proxy {
+    namespace detail {
+        template <class Ty, class AtomicType>
+        auto _proxy_state_of(const proxy_ptr<Ty, AtomicType>& ptr) {
+            return ptr._state();
+        }
+        template <class Ty, class AtomicType>
+        auto _proxy_state_of(const proxy_ref<Ty, AtomicType>& ptr) {
+            return ptr._state();
+        }
+
+        // open addressing table keyed by the state of the proxies, with
+        // linear probing and backward shift deletion. A control byte per
+        // slot keeps 7 bits of the hash, so most probes don't touch the
+        // entries. The expired entries are dropped by the inserts and the
+        // erases walking over them, by the rehash and by purge_expired();
+        // until then they are counted by size() but skipped by the
+        // iterators. The lookups don't drop anything, so they keep the
+        // iterators valid.
+        template <class Key, class Value, class AtomicType, bool IsMap>
+        class _proxy_flat_table {
+           public:
+            using key_type = proxy_ptr<Key, AtomicType>;
+            using mapped_type = Value;
+            // a moved entry of a map copies its const key
+            using value_type =
+                std::conditional_t<IsMap, std::pair<const key_type, Value>,
+                                   key_type>;
+            using size_type = size_t;
+
+            template <bool Const> class _iterator {
+               public:
+                using table_type = std::conditional_t<Const,
+                                                      const _proxy_flat_table,
+                                                      _proxy_flat_table>;
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = _proxy_flat_table::value_type;
+                using difference_type = std::ptrdiff_t;
+                using reference =
+                    std::conditional_t<Const, const value_type&, value_type&>;
+                using pointer =
+                    std::conditional_t<Const, const value_type*, value_type*>;
+
+                _iterator() = default;
+                _iterator(table_type* table, size_t index)
+                    : _table(table), _index(index) {
+                    _skip();
+                }
+                template <bool Const2,
+                          class = std::enable_if_t<Const && !Const2>>
+                _iterator(const _iterator<Const2>& r)
+                    : _table(r._table), _index(r._index) {}
+
+                reference operator*() const { return _table->_slots[_index]; }
+                pointer operator->() const { return &_table->_slots[_index]; }
+
+                _iterator& operator++() {
+                    ++_index;
+                    _skip();
+                    return *this;
+                }
+                _iterator operator++(int) {
+                    auto tmp = *this;
+                    ++*this;
+                    return tmp;
+                }
+
+                bool operator==(const _iterator& r) const {
+                    return _index == r._index;
+                }
+                bool operator!=(const _iterator& r) const {
+                    return _index != r._index;
+                }
+
+               private:
+                template <bool> friend class _iterator;
+
+                void _skip() {
+                    while (_index < _table->_capacity &&
+                           !_table->_alive_at(_index))
+                        ++_index;
+                }
+
+                table_type* _table = nullptr;
+                size_t _index = 0;
+            };
+
+            // the keys can't be modified, the values of the maps can
+            using iterator = _iterator<!IsMap>;
+            using const_iterator = _iterator<true>;
+
+            _proxy_flat_table() = default;
+            _proxy_flat_table(const _proxy_flat_table& r) {
+                reserve(r.size());
+                for (auto& value : r)
+                    _emplace_value(value);
+            }
+            _proxy_flat_table(_proxy_flat_table&& r) noexcept { swap(r); }
+            _proxy_flat_table& operator=(_proxy_flat_table r) noexcept {
+                swap(r);
+                return *this;
+            }
+            ~_proxy_flat_table() {
+                clear();
+                _deallocate(_ctrl, _slots, _capacity);
+            }
+
+            iterator begin() { return {this, 0}; }
+            iterator end() { return {this, _capacity}; }
+            const_iterator begin() const { return {this, 0}; }
+            const_iterator end() const { return {this, _capacity}; }
+
+            // it counts the expired entries not dropped yet
+            size_t size() const noexcept { return _size; }
+            bool empty() const noexcept { return _size == 0; }
+            size_t capacity() const noexcept { return _capacity; }
+
+            template <class K> iterator find(const K& key) {
+                return {this, _index_or_end(_find_alive(_proxy_state_of(key)))};
+            }
+            template <class K> const_iterator find(const K& key) const {
+                return {this, _index_or_end(_find_alive(_proxy_state_of(key)))};
+            }
+            template <class K> bool contains(const K& key) const {
+                return _find_alive(_proxy_state_of(key)) != _npos;
+            }
+
+            template <class K> bool erase(const K& key) {
+                const auto index = _find(_proxy_state_of(key));
+                if (index == _npos)
+                    return false;
+                _erase_at(index);
+                return true;
+            }
+
+            void clear() {
+                for (size_t i = 0; i < _capacity; i++) {
+                    if (_ctrl[i]) {
+                        _slots[i].~value_type();
+                        _ctrl[i] = 0;
+                    }
+                }
+                _size = 0;
+                _cursor = 0;
+            }
+
+            void reserve(size_t count) {
+                if (count * 4 > _capacity * 3)
+                    _rehash(count);
+            }
+
+            // drops the expired entries met in the next budget slots, the
+            // scan resumes from there the next call. Returns the number of
+            // dropped entries.
+            size_t purge_expired(size_t budget = ~size_t(0)) {
+                size_t dropped = 0;
+                if (budget >= _capacity) {
+                    for (size_t i = 0; i < _capacity;) {
+                        if (_ctrl[i] && _expired(i))
+                            _erase_at(i), dropped++;
+                        else
+                            i++;
+                    }
+                    return dropped;
+                }
+
+                for (size_t n = 0; n < budget; n++) {
+                    if (_ctrl[_cursor] && _expired(_cursor))
+                        _erase_at(_cursor), dropped++;
+                    else
+                        _cursor = (_cursor + 1) & _mask();
+                }
+                return dropped;
+            }
+
+            void swap(_proxy_flat_table& r) noexcept {
+                std::swap(_ctrl, r._ctrl);
+                std::swap(_slots, r._slots);
+                std::swap(_capacity, r._capacity);
+                std::swap(_size, r._size);
+                std::swap(_cursor, r._cursor);
+            }
+
+           protected:
+            using state_type = _proxy_common_state_base<AtomicType>;
+            static constexpr size_t _npos = ~size_t(0);
+
+            // expired keys are never stored
+            template <class... Args>
+            std::pair<iterator, bool> _emplace(const key_type& key,
+                                               Args&&... args) {
+                const auto state = key._state();
+                if (!state || !state->alive())
+                    return {end(), false};
+                if (auto index = _find(state); index != _npos)
+                    return {{this, index}, false};
+
+                if ((_size + 1) * 4 > _capacity * 3)
+                    _rehash(_size + 1);
+                // _find() dropped the expired entries of the probe sequence
+                const auto hash = _hash(state);
+                auto index = hash & _mask();
+                while (_ctrl[index])
+                    index = (index + 1) & _mask();
+
+                if constexpr (IsMap)
+                    ::new (static_cast<void*>(_slots + index))
+                        value_type(std::piecewise_construct,
+                                   std::forward_as_tuple(key),
+                                   std::forward_as_tuple(
+                                       std::forward<Args>(args)...));
+                else
+                    ::new (static_cast<void*>(_slots + index)) value_type(key);
+                _ctrl[index] = _tag(hash);
+                _size++;
+                return {{this, index}, true};
+            }
+
+           private:
+            static size_t _hash(const state_type* state) {
+                return _proxy_hash_mix(state);
+            }
+            static std::uint8_t _tag(size_t hash) {
+                return static_cast<std::uint8_t>(
+                    0x80 | (hash >> (sizeof(size_t) * 8 - 7)));
+            }
+            static const key_type& _key(const value_type& value) {
+                if constexpr (IsMap)
+                    return value.first;
+                else
+                    return value;
+            }
+
+            size_t _mask() const { return _capacity - 1; }
+            size_t _index_or_end(size_t index) const {
+                return index == _npos ? _capacity : index;
+            }
+            bool _expired(size_t index) const {
+                return !_key(_slots[index])._state()->alive();
+            }
+            bool _alive_at(size_t index) const {
+                return _ctrl[index] && !_expired(index);
+            }
+
+            void _emplace_value(const value_type& value) {
+                if constexpr (IsMap)
+                    _emplace(value.first, value.second);
+                else
+                    _emplace(value);
+            }
+
+            // the expired entries met on the way are dropped, for the
+            // inserts and the erases only
+            size_t _find(const state_type* state) {
+                if (!state || !_capacity)
+                    return _npos;
+                const auto hash = _hash(state);
+                const auto tag = _tag(hash);
+                for (auto index = hash & _mask(); _ctrl[index];) {
+                    const bool match = _ctrl[index] == tag &&
+                                       _key(_slots[index])._state() == state;
+                    if (_expired(index)) {
+                        _erase_at(index);
+                        if (match)
+                            return _npos;
+                        continue;
+                    }
+                    if (match)
+                        return index;
+                    index = (index + 1) & _mask();
+                }
+                return _npos;
+            }
+
+            size_t _find_alive(const state_type* state) const {
+                if (!state || !_capacity)
+                    return _npos;
+                const auto hash = _hash(state);
+                const auto tag = _tag(hash);
+                for (auto index = hash & _mask(); _ctrl[index];
+                     index = (index + 1) & _mask()) {
+                    if (_ctrl[index] == tag &&
+                        _key(_slots[index])._state() == state)
+                        return _expired(index) ? _npos : index;
+                }
+                return _npos;
+            }
+
+            // the entries after the hole move back, unless it would put
+            // them before their home slot
+            void _erase_at(size_t hole) {
+                _slots[hole].~value_type();
+                _ctrl[hole] = 0;
+                _size--;
+                for (auto index = (hole + 1) & _mask(); _ctrl[index];
+                     index = (index + 1) & _mask()) {
+                    const auto home =
+                        _hash(_key(_slots[index])._state()) & _mask();
+                    if (((index - home) & _mask()) < ((index - hole) & _mask()))
+                        continue;
+                    ::new (static_cast<void*>(_slots + hole))
+                        value_type(std::move(_slots[index]));
+                    _slots[index].~value_type();
+                    _ctrl[hole] = std::exchange(_ctrl[index], 0);
+                    hole = index;
+                }
+            }
+
+            // the expired entries aren't carried over
+            void _rehash(size_t count) {
+                size_t alive = 0;
+                for (size_t i = 0; i < _capacity; i++)
+                    alive += _alive_at(i);
+
+                size_t capacity = 8;
+                while (std::max(count, alive + 1) * 4 > capacity * 3)
+                    capacity *= 2;
+
+                auto ctrl = new std::uint8_t[capacity]();
+                auto slots = std::allocator<value_type>().allocate(capacity);
+                for (size_t i = 0; i < _capacity; i++) {
+                    if (!_ctrl[i])
+                        continue;
+                    if (!_expired(i)) {
+                        const auto hash = _hash(_key(_slots[i])._state());
+                        auto index = hash & (capacity - 1);
+                        while (ctrl[index])
+                            index = (index + 1) & (capacity - 1);
+                        ::new (static_cast<void*>(slots + index))
+                            value_type(std::move(_slots[i]));
+                        ctrl[index] = _ctrl[i];
+                    }
+                    _slots[i].~value_type();
+                }
+
+                _deallocate(_ctrl, _slots, _capacity);
+                _ctrl = ctrl;
+                _slots = slots;
+                _capacity = capacity;
+                _size = alive;
+                _cursor = 0;
+            }
+
+            static void _deallocate(std::uint8_t* ctrl, value_type* slots,
+                                    size_t capacity) {
+                if (!capacity)
+                    return;
+                delete[] ctrl;
+                std::allocator<value_type>().deallocate(slots, capacity);
+            }
+
+            std::uint8_t* _ctrl = nullptr;
+            value_type* _slots = nullptr;
+            size_t _capacity = 0;
+            size_t _size = 0;
+            size_t _cursor = 0;
+        };
+    }  // namespace detail
+
+    // map keyed by proxy_ptr that drops the expired entries by itself.
+    // The lookups accept any proxy_ptr or proxy_ref sharing the key state.
+    template <class Key, class Value, class AtomicType = proxy_non_atomic>
+    class proxy_flat_map
+        : public detail::_proxy_flat_table<Key, Value, AtomicType, true> {
+        using base_type =
+            detail::_proxy_flat_table<Key, Value, AtomicType, true>;
+
+       public:
+        using typename base_type::iterator;
+        using typename base_type::key_type;
+        using typename base_type::value_type;
+
+        // fails for an expired key
+        template <class... Args>
+        std::pair<iterator, bool> try_emplace(const key_type& key,
+                                              Args&&... args) {
+            return this->_emplace(key, std::forward<Args>(args)...);
+        }
+        std::pair<iterator, bool> insert(const value_type& value) {
+            return this->_emplace(value.first, value.second);
+        }
+
+        // another owner can expire the key at any time, so an expired key
+        // throws std::out_of_range where try_emplace() returns end()
+        Value& operator[](const key_type& key) {
+            auto it = try_emplace(key).first;
+            if (it == this->end())
+                throw std::out_of_range("proxy_flat_map: the key expired");
+            return it->second;
+        }
+    };
+
+    // set of proxy_ptr that drops the expired entries by itself
+    template <class Key, class AtomicType = proxy_non_atomic>
+    class proxy_flat_set
+        : public detail::_proxy_flat_table<Key, void, AtomicType, false> {
+        using base_type =
+            detail::_proxy_flat_table<Key, void, AtomicType, false>;
+
+       public:
+        using typename base_type::iterator;
+        using typename base_type::key_type;
+
+        // fails for an expired key
+        std::pair<iterator, bool> insert(const key_type& key) {
+            return this->_emplace(key);
+        }
+    };
+}  // namespace proxy
+
+#endif
@@ -0,0 +1,198 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2022 IkarusDeveloper. All rights reserved.
+//
+// This code is licensed under the MIT License (MIT).
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef __PROXY_PROXY_HANDLE_H__
+    #define __PROXY_PROXY_HANDLE_H__
+
+    #include "proxy_ptr.h"
+    #include <cstdint>
+    #include <functional>
+    #include <vector>
+
+namespace proxy {
+    template <class Ty> class proxy_registry;
+
+    // index/generation pair resolved through a proxy_registry, it holds no
+    // reference so copying it is free
+    template <class Ty> class proxy_handle {
+       public:
+        static constexpr std::uint32_t npos = ~std::uint32_t(0);
+
+        constexpr proxy_handle() noexcept = default;
+        constexpr proxy_handle(std::nullptr_t) noexcept {}
+
+        constexpr std::uint32_t index() const noexcept { return _index; }
+        constexpr std::uint32_t generation() const noexcept {
+            return _generation;
+        }
+
+        // it doesn't tell if the handle is still valid, use the registry
+        constexpr explicit operator bool() const noexcept {
+            return _index != npos;
+        }
+
+        PROXY_PTR_NO_DISCARD constexpr bool operator==(
+            const proxy_handle& _Right) const noexcept {
+            return _index == _Right._index && _generation == _Right._generation;
+        }
+        PROXY_PTR_NO_DISCARD constexpr bool operator!=(
+            const proxy_handle& _Right) const noexcept {
+            return !(*this == _Right);
+        }
+        PROXY_PTR_NO_DISCARD constexpr bool operator<(
+            const proxy_handle& _Right) const noexcept {
+            return _index != _Right._index ? _index < _Right._index
+                                           : _generation < _Right._generation;
+        }
+
+       private:
+        friend class proxy_registry<Ty>;
+
+        constexpr proxy_handle(std::uint32_t index,
+                               std::uint32_t generation) noexcept
+            : _index(index), _generation(generation) {}
+
+        std::uint32_t _index = npos;
+        std::uint32_t _generation = 0;
+    };
+
+    static_assert(std::is_trivially_copyable_v<proxy_handle<int>>);
+    static_assert(sizeof(proxy_handle<int>) == sizeof(std::uint64_t));
+
+    // slot map of non-owned objects: resolving a handle is a bounds check
+    // plus a generation compare, erasing it is a generation bump
+    template <class Ty> class proxy_registry {
+       public:
+        using handle_type = proxy_handle<Ty>;
+
+        proxy_registry() = default;
+        proxy_registry(const proxy_registry&) = delete;
+        proxy_registry& operator=(const proxy_registry&) = delete;
+
+        handle_type insert(Ty* ptr) {
+            assert(ptr);
+            std::uint32_t index = _free_head;
+            if (index != handle_type::npos) {
+                _free_head = _slots[index].next_free;
+            } else {
+                assert(_slots.size() < handle_type::npos);
+                index = static_cast<std::uint32_t>(_slots.size());
+                _slots.push_back({nullptr, 1, handle_type::npos});
+            }
+
+            auto& slot = _slots[index];
+            slot.ptr = ptr;
+            slot.next_free = handle_type::npos;
+            _size++;
+            return handle_type{index, slot.generation};
+        }
+
+        bool erase(handle_type handle) noexcept {
+            if (!contains(handle))
+                return false;
+
+            auto& slot = _slots[handle.index()];
+            slot.ptr = nullptr;
+            // generation 0 is never handed out
+            if (++slot.generation == 0)
+                slot.generation = 1;
+            slot.next_free = _free_head;
+            _free_head = handle.index();
+            _size--;
+            return true;
+        }
+
+        PROXY_PTR_NO_DISCARD bool contains(handle_type handle) const noexcept {
+            return handle.index() < _slots.size() &&
+                   _slots[handle.index()].generation == handle.generation() &&
+                   _slots[handle.index()].ptr;
+        }
+
+        PROXY_PTR_NO_DISCARD Ty* resolve(handle_type handle) const noexcept {
+            return contains(handle) ? _slots[handle.index()].ptr : nullptr;
+        }
+
+        // the proxy of a resolved proxy_parent_base/proxy_intrusive_base
+        template <class Type2 = Ty>
+        auto proxy(handle_type handle) const
+            -> decltype(std::declval<Type2*>()->proxy()) {
+            if (auto ptr = resolve(handle))
+                return ptr->proxy();
+            return nullptr;
+        }
+
+        template <class Func> void for_each(Func func) const {
+            for (auto& slot : _slots)
+                if (slot.ptr)
+                    func(slot.ptr);
+        }
+
+        size_t size() const noexcept { return _size; }
+        bool empty() const noexcept { return _size == 0; }
+        size_t capacity() const noexcept { return _slots.size(); }
+        void reserve(size_t count) { _slots.reserve(count); }
+
+       private:
+        struct _slot {
+            Ty* ptr;
+            std::uint32_t generation;
+            std::uint32_t next_free;
+        };
+
+        std::vector<_slot> _slots;
+        std::uint32_t _free_head = handle_type::npos;
+        size_t _size = 0;
+    };
+
+    // mixin to hand out a handle next to the proxy_parent_base proxies, the
+    // object is registered on the first handle() and erased when destroyed.
+    // The registry must outlive the object.
+    template <class Type> class proxy_handle_base {
+       public:
+        proxy_handle_base(proxy_registry<Type>& registry)
+            : _registry(&registry) {}
+        // the handles belong to the object they were generated from
+        proxy_handle_base(const proxy_handle_base& r)
+            : _registry(r._registry) {}
+        proxy_handle_base& operator=(const proxy_handle_base&) {
+            return *this;
+        }
+
+        proxy_handle<Type> handle() {
+            if (!_registry->contains(_handle))
+                _handle = _registry->insert(static_cast<Type*>(this));
+            return _handle;
+        }
+
+        void handle_delete() { _registry->erase(_handle); }
+
+        virtual ~proxy_handle_base() { handle_delete(); }
+
+       private:
+        proxy_registry<Type>* _registry;
+        proxy_handle<Type> _handle;
+    };
+}  // namespace proxy
+
+template <class Type> struct std::hash<proxy::proxy_handle<Type>> {
+    size_t operator()(const proxy::proxy_handle<Type>& _handle) const {
+        const auto key = (std::uint64_t(_handle.generation()) << 32) |
+                         _handle.index();
+        return std::hash<std::uint64_t>()(key);
+    }
+};
+
+#endif
@@ -19,11 +19,86 @@
 
     #include <type_traits>
     #include <assert.h>
+    #include <algorithm>
     #include <atomic>
+    #include <chrono>
+    #include <cstdint>
+    #include <cstring>
+    #include <functional>
+    #include <new>
     #include <memory>
+    #include <mutex>
+    #include <typeinfo>
+    #include <utility>
+    #include <vector>
+
+    // define it as 1 to allocate every control block from the pool
+    #ifndef PROXY_PTR_USE_POOL
+        #define PROXY_PTR_USE_POOL 0
+    #endif
+
+    // define it as 1 to queue every deleter until proxy_drain_deletes()
+    #ifndef PROXY_PTR_DEFERRED_DELETE
+        #define PROXY_PTR_DEFERRED_DELETE 0
+    #endif
+
+    // define it as 1 to count the control blocks and the refcount traffic
+    // of every type, see proxy::stats()
+    #ifndef PROXY_PTR_STATS
+        #define PROXY_PTR_STATS 0
+    #endif
+
+    // define it as 1 to record the lifetime events of the control blocks in
+    // a ring per thread, see proxy_trace.h
+    #ifndef PROXY_PTR_TRACE
+        #define PROXY_PTR_TRACE 0
+    #endif
+
+    // events kept by each thread, a power of two
+    #ifndef PROXY_PTR_TRACE_CAPACITY
+        #define PROXY_PTR_TRACE_CAPACITY 16384
+    #endif
+
+    // 1 when the leak sanitizer runs, the pool slabs are then registered as
+    // kept on purpose so they aren't reported at exit
+    #ifndef PROXY_PTR_LSAN
+        #if defined(__SANITIZE_ADDRESS__) && !defined(_MSC_VER)
+            #define PROXY_PTR_LSAN 1
+        #elif defined(__has_feature)
+            #if __has_feature(address_sanitizer) || \
+                __has_feature(leak_sanitizer)
+                #define PROXY_PTR_LSAN 1
+            #endif
+        #endif
+        #ifndef PROXY_PTR_LSAN
+            #define PROXY_PTR_LSAN 0
+        #endif
+    #endif
+    #if PROXY_PTR_LSAN
+        #include <sanitizer/lsan_interface.h>
+    #endif
 
     #define PROXY_PTR_NO_DISCARD [[nodiscard]]
     #define PROXY_PTR_UNUSED(v) ((void)v)
+    // keeps the stores before it, GCC drops the stores of a destructor into
+    // its own object otherwise (-flifetime-dse)
+    #if defined(__GNUC__)
+        #define PROXY_PTR_KEEP_STORES() asm volatile("" ::: "memory")
+    #else
+        #define PROXY_PTR_KEEP_STORES() \
+            std::atomic_signal_fence(std::memory_order_seq_cst)
+    #endif
+    // the states are downcast once their flags are checked, GCC can't see
+    // the check after inlining them for a smaller state and warns
+    #if defined(__GNUC__) && !defined(__clang__)
+        #define PROXY_PTR_DOWNCAST_BEGIN \
+            _Pragma("GCC diagnostic push") \
+                _Pragma("GCC diagnostic ignored \"-Warray-bounds\"")
+        #define PROXY_PTR_DOWNCAST_END _Pragma("GCC diagnostic pop")
+    #else
+        #define PROXY_PTR_DOWNCAST_BEGIN
+        #define PROXY_PTR_DOWNCAST_END
+    #endif
     #if __cplusplus >= 201703L
         #define PROXY_PTR_IS_ARRAY(type) std::is_array_v<type>
         #define PROXY_PTR_EXTENT(type) std::extent_v<type>
@@ -37,14 +112,314 @@
 namespace proxy {
     struct proxy_atomic {};
     struct proxy_non_atomic {};
+    // atomic, but the thread creating the state counts its own references
+    // without locked operations
+    struct proxy_biased {};
 
     // forward declaration
     template <class Ty> class proxy_parent_base;
+    template <class Ty> class proxy_intrusive_base;
     template <typename Ty> using enable_proxy_from_this = proxy_parent_base<Ty>;
 
+    // specialize it as std::true_type to allocate the control blocks of a
+    // single type from the pool
+    template <class Ty>
+    struct proxy_use_pool : std::bool_constant<PROXY_PTR_USE_POOL != 0> {};
+
+    // specialize it as std::true_type to run the deleters of a single type
+    // in proxy_drain_deletes() instead of inside proxy_delete()
+    template <class Ty>
+    struct proxy_deferred_delete
+        : std::bool_constant<PROXY_PTR_DEFERRED_DELETE != 0> {};
+
+    struct proxy_pool_stats {
+        size_t in_use = 0;
+        size_t pooled = 0;
+    };
+
+    // counters of the control blocks, zombies are the blocks expired while
+    // proxies were still referencing them and not freed yet
+    struct proxy_type_stats {
+        const char* name = "";
+        std::uint64_t allocated = 0;
+        std::uint64_t freed = 0;
+        std::uint64_t live = 0;
+        std::uint64_t live_bytes = 0;
+        std::uint64_t inc_ref = 0;
+        std::uint64_t dec_ref = 0;
+        std::uint64_t proxy_delete = 0;
+        std::uint64_t zombies = 0;
+        std::uint64_t zombie_bytes = 0;
+    };
+
+    struct proxy_stats_snapshot {
+        proxy_type_stats total;
+        std::vector<proxy_type_stats> types;
+    };
+
+    constexpr bool proxy_stats_enabled = PROXY_PTR_STATS != 0;
+
     namespace detail {
         template <class... args> using void_t = void;
 
+        // size classes of 16 bytes up to 256 bytes, bigger blocks and
+        // over-aligned blocks are left to the global operator new
+        constexpr size_t _pool_granularity = 16;
+        constexpr size_t _pool_class_count = 16;
+        constexpr size_t _pool_slab_blocks = 64;
+
+        constexpr size_t _pool_class_of(size_t size) {
+            return (size + _pool_granularity - 1) / _pool_granularity - 1;
+        }
+        constexpr size_t _pool_class_size(size_t cls) {
+            return (cls + 1) * _pool_granularity;
+        }
+
+        constexpr size_t _pool_max_size =
+            _pool_class_size(_pool_class_count - 1);
+
+        struct _pool_node {
+            _pool_node* next;
+        };
+
+        // slabs are never given back, they are recycled through the freelists.
+        // A block may still be in use or popped by a racing thread when the
+        // process exits, so they stay allocated for its whole lifetime
+        inline _pool_node* _pool_new_slab(size_t cls, _pool_node*& last) {
+            const auto size = _pool_class_size(cls);
+            auto slab = static_cast<unsigned char*>(
+                ::operator new(size * _pool_slab_blocks));
+    #if PROXY_PTR_LSAN
+            // the tagged heads of the global pool hide them from the checker
+            __lsan_ignore_object(slab);
+    #endif
+            for (size_t i = 0; i < _pool_slab_blocks - 1; i++)
+                reinterpret_cast<_pool_node*>(slab + i * size)->next =
+                    reinterpret_cast<_pool_node*>(slab + (i + 1) * size);
+            last = reinterpret_cast<_pool_node*>(
+                slab + (_pool_slab_blocks - 1) * size);
+            last->next = nullptr;
+            return reinterpret_cast<_pool_node*>(slab);
+        }
+
+        // lock-free treiber stacks shared by every thread (proxy_atomic),
+        // the head keeps an ABA tag in the unused high bits of the pointer
+        class _proxy_global_pool {
+           public:
+            static _proxy_global_pool& instance() {
+                static _proxy_global_pool pool;
+                return pool;
+            }
+
+            void* allocate(size_t cls) {
+                auto node = _pop(cls);
+                if (!node) {
+                    _pool_node* last = nullptr;
+                    node = _pool_new_slab(cls, last);
+                    _push(cls, node->next, last);
+                    _pooled.fetch_add(_pool_slab_blocks - 1,
+                                      std::memory_order_relaxed);
+                } else {
+                    _pooled.fetch_sub(1, std::memory_order_relaxed);
+                }
+                _in_use.fetch_add(1, std::memory_order_relaxed);
+                return node;
+            }
+
+            void deallocate(void* ptr, size_t cls) {
+                auto node = static_cast<_pool_node*>(ptr);
+                _push(cls, node, node);
+                _in_use.fetch_sub(1, std::memory_order_relaxed);
+                _pooled.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // takes a whole chain of free blocks (e.g. from a dying thread)
+            void adopt(size_t cls, _pool_node* first, _pool_node* last,
+                       size_t count) {
+                _push(cls, first, last);
+                _pooled.fetch_add(count, std::memory_order_relaxed);
+            }
+
+            proxy_pool_stats stats() const {
+                proxy_pool_stats ret;
+                ret.in_use = _in_use.load(std::memory_order_relaxed);
+                ret.pooled = _pooled.load(std::memory_order_relaxed);
+                return ret;
+            }
+
+           private:
+            using tagged_t = std::uint64_t;
+            static constexpr unsigned _ptr_bits =
+                sizeof(void*) == 8 ? 48 : 32;
+            static constexpr tagged_t _ptr_mask =
+                (tagged_t(1) << _ptr_bits) - 1;
+
+            static _pool_node* _node(tagged_t v) {
+                return reinterpret_cast<_pool_node*>(
+                    static_cast<std::uintptr_t>(v & _ptr_mask));
+            }
+            static tagged_t _pack(_pool_node* node, tagged_t old) {
+                auto tag = (old >> _ptr_bits) + 1;
+                return (tag << _ptr_bits) |
+                       static_cast<tagged_t>(
+                           reinterpret_cast<std::uintptr_t>(node));
+            }
+
+            void _push(size_t cls, _pool_node* first, _pool_node* last) {
+                auto& head = _heads[cls];
+                auto old = head.load(std::memory_order_relaxed);
+                do {
+                    last->next = _node(old);
+                } while (!head.compare_exchange_weak(
+                    old, _pack(first, old), std::memory_order_release,
+                    std::memory_order_relaxed));
+            }
+
+            _pool_node* _pop(size_t cls) {
+                auto& head = _heads[cls];
+                auto old = head.load(std::memory_order_acquire);
+                while (auto node = _node(old)) {
+                    // the slabs are never freed so reading a stale next is
+                    // harmless, the tag makes the exchange fail
+                    if (head.compare_exchange_weak(
+                            old, _pack(node->next, old),
+                            std::memory_order_acquire,
+                            std::memory_order_acquire))
+                        return node;
+                }
+                return nullptr;
+            }
+
+            std::atomic<tagged_t> _heads[_pool_class_count] = {};
+            std::atomic<size_t> _in_use{0};
+            std::atomic<size_t> _pooled{0};
+        };
+
+        // plain freelists owned by the calling thread (proxy_non_atomic),
+        // handed over to the global pool when the thread exits
+        class _proxy_local_pool {
+           public:
+            static _proxy_local_pool& instance() {
+                thread_local _proxy_local_pool pool;
+                thread_local _retire_guard guard{pool};
+                return pool;
+            }
+
+            void* allocate(size_t cls) {
+                if (_retired)
+                    return _proxy_global_pool::instance().allocate(cls);
+
+                auto node = _heads[cls];
+                if (!node) {
+                    _pool_node* last = nullptr;
+                    node = _pool_new_slab(cls, last);
+                    _counts[cls] += _pool_slab_blocks;
+                    _pooled += _pool_slab_blocks;
+                }
+                _heads[cls] = node->next;
+                _counts[cls]--;
+                _pooled--;
+                _in_use++;
+                return node;
+            }
+
+            void deallocate(void* ptr, size_t cls) {
+                if (_retired)
+                    return _proxy_global_pool::instance().deallocate(ptr, cls);
+
+                auto node = static_cast<_pool_node*>(ptr);
+                node->next = _heads[cls];
+                _heads[cls] = node;
+                _counts[cls]++;
+                _pooled++;
+                _in_use--;
+            }
+
+            proxy_pool_stats stats() const {
+                proxy_pool_stats ret;
+                ret.in_use = _in_use;
+                ret.pooled = _pooled;
+                return ret;
+            }
+
+           private:
+            struct _retire_guard {
+                _proxy_local_pool& pool;
+                ~_retire_guard() { pool._retire(); }
+            };
+
+            void _retire() {
+                auto& global = _proxy_global_pool::instance();
+                for (size_t cls = 0; cls < _pool_class_count; cls++) {
+                    auto first = _heads[cls];
+                    if (!first)
+                        continue;
+                    auto last = first;
+                    while (last->next)
+                        last = last->next;
+                    global.adopt(cls, first, last, _counts[cls]);
+                    _heads[cls] = nullptr;
+                    _counts[cls] = 0;
+                }
+                _pooled = 0;
+                _retired = true;
+            }
+
+            // zero-initialized as thread_local and trivially destructible,
+            // so it's still usable by the objects destroyed after the guard
+            _pool_node* _heads[_pool_class_count];
+            size_t _counts[_pool_class_count];
+            size_t _in_use;
+            size_t _pooled;
+            bool _retired;
+        };
+
+        template <class AtomicType> struct _deduce_pool_type;
+        template <> struct _deduce_pool_type<proxy_atomic> {
+            using type = _proxy_global_pool;
+        };
+        template <> struct _deduce_pool_type<proxy_non_atomic> {
+            using type = _proxy_local_pool;
+        };
+        template <> struct _deduce_pool_type<proxy_biased> {
+            using type = _proxy_global_pool;
+        };
+
+        template <class AtomicType>
+        using deduce_pool_type = typename _deduce_pool_type<AtomicType>::type;
+
+        // class-specific allocation functions inherited by the states
+        template <bool UsePool, class AtomicType>
+        struct _proxy_state_allocator {};
+
+        template <class AtomicType>
+        struct _proxy_state_allocator<true, AtomicType> {
+            using pool_type = deduce_pool_type<AtomicType>;
+
+            static void* operator new(size_t size) {
+                if (size > _pool_max_size)
+                    return ::operator new(size);
+                return pool_type::instance().allocate(_pool_class_of(size));
+            }
+            static void operator delete(void* ptr, size_t size) {
+                if (size > _pool_max_size)
+                    return ::operator delete(ptr);
+                pool_type::instance().deallocate(ptr, _pool_class_of(size));
+            }
+
+            static void* operator new(size_t size, std::align_val_t al) {
+                return ::operator new(size, al);
+            }
+            static void operator delete(void* ptr, size_t size,
+                                        std::align_val_t al) {
+                ::operator delete(ptr, size, al);
+            }
+        };
+
+        template <class Type, class AtomicType>
+        using proxy_state_allocator = _proxy_state_allocator<
+            proxy_use_pool<std::remove_cv_t<Type>>::value, AtomicType>;
+
         template <class _Fx, class _Arg, class = void>
         struct _can_call_function_object : std::false_type {};
         template <class _Fx, class _Arg>
@@ -53,76 +428,1272 @@ namespace proxy {
             void_t<decltype(std::declval<_Fx>()(std::declval<_Arg>()))>>
             : std::true_type {};
 
-        template <class Ty> struct _deduce_ref_count_type;
-        template <> struct _deduce_ref_count_type<proxy_atomic> {
-            using type = std::atomic<size_t>;
-        };
-        template <> struct _deduce_ref_count_type<proxy_non_atomic> {
-            using type = size_t;
+        template <class Ty> struct _deduce_ref_count_type;
+        template <> struct _deduce_ref_count_type<proxy_atomic> {
+            using type = std::atomic<std::uint64_t>;
+        };
+        template <> struct _deduce_ref_count_type<proxy_non_atomic> {
+            using type = std::uint64_t;
+        };
+        template <> struct _deduce_ref_count_type<proxy_biased> {
+            using type = std::atomic<std::uint64_t>;
+        };
+
+        template <class Ty>
+        using deduce_ref_count_type = typename _deduce_ref_count_type<Ty>::type;
+
+        template <class AtomicType> class _proxy_common_state_base;
+
+        // per-thread record of the proxy_biased owners: the other threads
+        // queue here the states whose shared count went below zero, and the
+        // owner merges them in flush(). The records are never freed, the
+        // record of an exited thread is handed to the next one asking for it
+        class _proxy_biased_owner {
+           public:
+            using state_type = _proxy_common_state_base<proxy_biased>;
+
+            // nullptr until the calling thread creates a state
+            static _proxy_biased_owner* current() noexcept { return _current; }
+            static _proxy_biased_owner* local() {
+                if (!_current && !_exited) {
+                    thread_local _thread_holder holder;
+                    _current = _acquire();
+                }
+                return _current;
+            }
+
+            void push(state_type* state) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _queue.push_back(state);
+            }
+
+            size_t flush();
+
+           private:
+            struct _thread_holder {
+                ~_thread_holder() {
+                    _current->flush();
+                    _current->_in_use.store(false, std::memory_order_release);
+                    _current = nullptr;
+                    _exited = true;
+                }
+            };
+
+            static _proxy_biased_owner* _acquire() {
+                for (auto record = _records.load(); record;
+                     record = record->_next) {
+                    bool expected = false;
+                    if (!record->_in_use.load(std::memory_order_relaxed) &&
+                        record->_in_use.compare_exchange_strong(expected, true))
+                        return record;
+                }
+
+                auto record = new _proxy_biased_owner;
+                record->_next = _records.load(std::memory_order_relaxed);
+                while (!_records.compare_exchange_weak(record->_next, record))
+                    ;
+                return record;
+            }
+
+            static inline thread_local _proxy_biased_owner* _current = nullptr;
+            static inline thread_local bool _exited = false;
+            static inline std::atomic<_proxy_biased_owner*> _records{nullptr};
+
+            std::atomic<bool> _in_use{true};
+            _proxy_biased_owner* _next = nullptr;
+            std::mutex _mutex;
+            std::vector<state_type*> _queue;
+        };
+
+        // deleters queued by the calling thread, run at its safe points.
+        // A thread exiting runs what's left, and from then on its deleters
+        // run inline.
+        class _proxy_reclaim_queue {
+           public:
+            using run_fn = void (*)(void*);
+            using clock_type = std::chrono::steady_clock;
+
+            // nullptr once the calling thread is exiting
+            static _proxy_reclaim_queue* local() {
+                if (_exited)
+                    return nullptr;
+                thread_local _proxy_reclaim_queue queue;
+                return &queue;
+            }
+
+            void push(void* state, run_fn run) {
+                _entries.push_back({state, run});
+            }
+
+            // at least one deleter runs before the deadline is checked, the
+            // ones queued while draining are run as well
+            size_t drain(clock_type::time_point deadline =
+                             clock_type::time_point::max()) {
+                const bool timed = deadline != clock_type::time_point::max();
+                size_t count = 0;
+                while (_head < _entries.size()) {
+                    if (timed && count && clock_type::now() >= deadline)
+                        break;
+                    const auto entry = _entries[_head++];
+                    entry.run(entry.state);
+                    count++;
+                }
+
+                if (_head == _entries.size()) {
+                    _entries.clear();
+                    _head = 0;
+                } else if (_head > _entries.size() / 2) {
+                    _entries.erase(_entries.begin(), _entries.begin() + _head);
+                    _head = 0;
+                }
+                return count;
+            }
+
+            size_t size() const { return _entries.size() - _head; }
+
+            ~_proxy_reclaim_queue() {
+                _exited = true;
+                drain();
+            }
+
+           private:
+            struct _entry {
+                void* state;
+                run_fn run;
+            };
+
+            static inline thread_local bool _exited = false;
+
+            std::vector<_entry> _entries;
+            size_t _head = 0;
+        };
+
+        // proxy_deletion_guard scopes of the calling thread: while one is
+        // open the proxy_non_atomic deleters are queued, and they run when
+        // the outermost one closes
+        class _proxy_deletion_scope {
+           public:
+            using run_fn = void (*)(void*);
+
+            static bool open() { return _depth != 0; }
+            static void enter() { _depth++; }
+            static void leave() {
+                assert(_depth);
+                if (--_depth)
+                    return;
+                // the deleters may delete again, and run those inline
+                auto& queue = _queue();
+                std::vector<_entry> entries;
+                while (!queue.empty()) {
+                    entries.swap(queue);
+                    for (auto& entry : entries)
+                        entry.run(entry.state);
+                    entries.clear();
+                }
+                queue.swap(entries);
+            }
+
+            static void push(void* state, run_fn run) {
+                _queue().push_back({state, run});
+            }
+            static size_t size() { return _queue().size(); }
+
+           private:
+            struct _entry {
+                void* state;
+                run_fn run;
+            };
+
+            static std::vector<_entry>& _queue() {
+                thread_local std::vector<_entry> queue;
+                return queue;
+            }
+
+            static inline thread_local size_t _depth = 0;
+        };
+
+        // murmur3 finalizer: the low bits of a pointer are alignment zeros
+        inline size_t _proxy_hash_mix(const void* ptr) {
+            std::uint64_t key = reinterpret_cast<std::uintptr_t>(ptr);
+            key ^= key >> 33;
+            key *= 0xff51afd7ed558ccdull;
+            key ^= key >> 33;
+            key *= 0xc4ceb9fe1a85ec53ull;
+            key ^= key >> 33;
+            return static_cast<size_t>(key);
+        }
+
+        struct _proxy_null_mutex {
+            void lock() {}
+            void unlock() {}
+        };
+
+        // hook of an expiration callback, linked in _proxy_expire_table
+        struct _proxy_expire_node {
+            using callback_type = void (*)(void* context);
+
+            const void* state = nullptr;
+            _proxy_expire_node* prev = nullptr;
+            _proxy_expire_node* next = nullptr;
+            callback_type callback = nullptr;
+            void* context = nullptr;
+        };
+
+        // lists of the expiration hooks by state, only looked up for the
+        // states flagged with expire_flag. The hooks are owned by their
+        // observers, so only the table itself ever allocates. The
+        // proxy_non_atomic table is per thread, the others are guarded by
+        // a recursive mutex since the callbacks run under it.
+        template <class AtomicType> class _proxy_expire_table {
+            static constexpr bool _is_atomic =
+                !std::is_same_v<AtomicType, proxy_non_atomic>;
+
+           public:
+            using mutex_type = std::conditional_t<_is_atomic,
+                                                  std::recursive_mutex,
+                                                  _proxy_null_mutex>;
+
+            static _proxy_expire_table& instance() {
+                if constexpr (_is_atomic) {
+                    static _proxy_expire_table table;
+                    return table;
+                } else {
+                    thread_local _proxy_expire_table table;
+                    return table;
+                }
+            }
+
+            mutex_type& mutex() { return _mutex; }
+
+            // called with the mutex held
+            void link(_proxy_expire_node* node) {
+                if ((_size + 1) * 2 > _slots.size())
+                    _grow();
+                auto& slot = _slots[_find(node->state)];
+                if (!slot.state) {
+                    slot.state = node->state;
+                    _size++;
+                }
+                node->prev = nullptr;
+                node->next = std::exchange(slot.head, node);
+                if (node->next)
+                    node->next->prev = node;
+            }
+
+            void unlink(_proxy_expire_node* node) {
+                const auto index = _find(node->state);
+                if (node->prev)
+                    node->prev->next = node->next;
+                else
+                    _slots[index].head = node->next;
+                if (node->next)
+                    node->next->prev = node->prev;
+                if (!_slots[index].head)
+                    _erase_at(index);
+                node->state = nullptr;
+            }
+
+            // the callbacks are popped one at a time, so they can unlink
+            // the other hooks of the same state
+            void fire(const void* state) {
+                std::lock_guard<mutex_type> lock(_mutex);
+                while (_size) {
+                    const auto index = _find(state);
+                    auto node = _slots[index].head;
+                    if (!node)
+                        break;
+                    unlink(node);
+                    node->callback(node->context);
+                }
+            }
+
+           private:
+            struct _slot {
+                const void* state = nullptr;
+                _proxy_expire_node* head = nullptr;
+            };
+
+            size_t _mask() const { return _slots.size() - 1; }
+
+            // the slot of state, or the empty slot ending its probe
+            size_t _find(const void* state) const {
+                auto index = _proxy_hash_mix(state) & _mask();
+                while (_slots[index].state && _slots[index].state != state)
+                    index = (index + 1) & _mask();
+                return index;
+            }
+
+            void _erase_at(size_t hole) {
+                _slots[hole] = {};
+                _size--;
+                for (auto index = (hole + 1) & _mask(); _slots[index].state;
+                     index = (index + 1) & _mask()) {
+                    const auto home =
+                        _proxy_hash_mix(_slots[index].state) & _mask();
+                    if (((index - home) & _mask()) < ((index - hole) & _mask()))
+                        continue;
+                    _slots[hole] = std::exchange(_slots[index], {});
+                    hole = index;
+                }
+            }
+
+            void _grow() {
+                auto slots = std::exchange(
+                    _slots, std::vector<_slot>(
+                                std::max<size_t>(16, _slots.size() * 2)));
+                for (auto& slot : slots)
+                    if (slot.state)
+                        _slots[_find(slot.state)] = slot;
+            }
+
+            std::vector<_slot> _slots;
+            size_t _size = 0;
+            mutex_type _mutex;
+        };
+
+        enum class _proxy_stat {
+            allocated,
+            freed,
+            inc_ref,
+            dec_ref,
+            deletes,
+            zombies,
+            zombies_freed,
+            count
+        };
+
+        // PROXY_PTR_STATS counters of a state type, also naming the type of
+        // the PROXY_PTR_TRACE events. The records are never freed and are
+        // linked in a global list on their first use, their ids start at 1.
+        struct _proxy_stats_record {
+            _proxy_stats_record(const char* type_name, size_t size)
+                : name(type_name), block_size(size), next(head().load()) {
+                do {
+                    id = next ? next->id + 1 : 1;
+                } while (!head().compare_exchange_weak(next, this));
+            }
+
+            static std::atomic<_proxy_stats_record*>& head() {
+                static std::atomic<_proxy_stats_record*> list{nullptr};
+                return list;
+            }
+
+            void add(_proxy_stat stat) {
+                counts[size_t(stat)].fetch_add(1, std::memory_order_relaxed);
+            }
+            std::uint64_t get(_proxy_stat stat) const {
+                return counts[size_t(stat)].load(std::memory_order_relaxed);
+            }
+
+            const char* name;
+            size_t block_size;
+            std::uint32_t id = 0;
+            std::atomic<std::uint64_t> counts[size_t(_proxy_stat::count)]{};
+            _proxy_stats_record* next;
+        };
+
+        template <class Type, class State>
+        _proxy_stats_record& _proxy_stats_of() {
+            static _proxy_stats_record record(typeid(Type).name(),
+                                              sizeof(State));
+            return record;
+        }
+
+        constexpr bool _proxy_records_enabled =
+            PROXY_PTR_STATS || PROXY_PTR_TRACE;
+
+        // the record of the state, empty without PROXY_PTR_STATS and
+        // PROXY_PTR_TRACE. only the stats count the zombies
+        template <bool Records, bool Zombies> struct _proxy_state_stats {};
+        template <> struct _proxy_state_stats<true, false> {
+            _proxy_stats_record* _stats = nullptr;
+        };
+        template <>
+        struct _proxy_state_stats<true, true>
+            : _proxy_state_stats<true, false> {
+            std::atomic<bool> _zombie{false};
+        };
+
+        enum class _proxy_trace_op : std::uint8_t {
+            create,
+            copy,
+            detach,
+            proxy_delete,
+            proxy_release,
+            last_detach
+        };
+
+        // PROXY_PTR_TRACE events of a thread: only its thread writes them,
+        // the readers drop the slots overwritten while they were copying
+        // them. The rings are never freed, the ring of an exited thread is
+        // handed to the next one asking for it and keeps its events.
+        class _proxy_trace_ring {
+           public:
+            static constexpr size_t capacity = PROXY_PTR_TRACE_CAPACITY;
+            static_assert(capacity && !(capacity & (capacity - 1)),
+                          "PROXY_PTR_TRACE_CAPACITY must be a power of two");
+
+            struct event {
+                std::uint64_t time_ns;
+                const void* block;
+                std::uint32_t type;
+                _proxy_trace_op op;
+            };
+
+            // nullptr once the calling thread is exiting
+            static _proxy_trace_ring* local() {
+                if (!_current && !_exited) {
+                    thread_local _thread_holder holder;
+                    _current = _acquire();
+                }
+                return _current;
+            }
+
+            static _proxy_trace_ring* first() { return _rings.load(); }
+            _proxy_trace_ring* next() const { return _next; }
+            std::uint32_t thread() const { return _thread; }
+
+            void push(_proxy_trace_op op, const void* block,
+                      std::uint32_t type) {
+                using namespace std::chrono;
+                const auto index = _head.load(std::memory_order_relaxed);
+                const auto now = steady_clock::now().time_since_epoch();
+                auto& slot = _slots[index & (capacity - 1)];
+
+                _begun.store(index + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                slot.time.store(duration_cast<nanoseconds>(now).count(),
+                                std::memory_order_relaxed);
+                slot.block.store(reinterpret_cast<std::uintptr_t>(block),
+                                 std::memory_order_relaxed);
+                slot.meta.store(std::uint64_t(type) << 8 | std::uint8_t(op),
+                                std::memory_order_relaxed);
+                _head.store(index + 1, std::memory_order_release);
+            }
+
+            // appends the events not cleared yet, oldest first
+            void copy(std::vector<event>& out) const {
+                const auto head = _head.load(std::memory_order_acquire);
+                auto first = std::max(_cleared.load(std::memory_order_relaxed),
+                                      head > capacity ? head - capacity : 0);
+                const auto size = out.size();
+                for (auto index = first; index < head; index++) {
+                    auto& slot = _slots[index & (capacity - 1)];
+                    const auto meta = slot.meta.load(std::memory_order_relaxed);
+                    const auto block = static_cast<std::uintptr_t>(
+                        slot.block.load(std::memory_order_relaxed));
+                    out.push_back({slot.time.load(std::memory_order_relaxed),
+                                   reinterpret_cast<const void*>(block),
+                                   static_cast<std::uint32_t>(meta >> 8),
+                                   static_cast<_proxy_trace_op>(meta & 0xff)});
+                }
+
+                // the writer may have lapped the reader meanwhile
+                std::atomic_thread_fence(std::memory_order_acquire);
+                const auto begun = _begun.load(std::memory_order_relaxed);
+                if (begun > first + capacity) {
+                    const auto lost = std::min<std::uint64_t>(
+                        begun - capacity - first, head - first);
+                    out.erase(out.begin() + size, out.begin() + size + lost);
+                }
+            }
+
+            void clear() {
+                _cleared.store(_head.load(std::memory_order_acquire),
+                               std::memory_order_relaxed);
+            }
+
+           private:
+            struct _slot {
+                std::atomic<std::uint64_t> time{0};
+                std::atomic<std::uint64_t> block{0};
+                std::atomic<std::uint64_t> meta{0};
+            };
+
+            struct _thread_holder {
+                ~_thread_holder() {
+                    _current->_in_use.store(false, std::memory_order_release);
+                    _current = nullptr;
+                    _exited = true;
+                }
+            };
+
+            static _proxy_trace_ring* _acquire() {
+                for (auto ring = _rings.load(); ring; ring = ring->_next) {
+                    bool expected = false;
+                    if (!ring->_in_use.load(std::memory_order_relaxed) &&
+                        ring->_in_use.compare_exchange_strong(expected, true))
+                        return ring;
+                }
+
+                // the thread index is read from a ring another thread
+                // published, the acquire pairs with its release
+                auto ring = new _proxy_trace_ring;
+                ring->_next = _rings.load(std::memory_order_acquire);
+                do {
+                    ring->_thread = ring->_next ? ring->_next->_thread + 1 : 0;
+                } while (!_rings.compare_exchange_weak(
+                    ring->_next, ring, std::memory_order_release,
+                    std::memory_order_acquire));
+                return ring;
+            }
+
+            static inline thread_local _proxy_trace_ring* _current = nullptr;
+            static inline thread_local bool _exited = false;
+            static inline std::atomic<_proxy_trace_ring*> _rings{nullptr};
+
+            std::atomic<bool> _in_use{true};
+            _proxy_trace_ring* _next = nullptr;
+            std::uint32_t _thread = 0;
+            std::atomic<std::uint64_t> _head{0};
+            std::atomic<std::uint64_t> _begun{0};
+            std::atomic<std::uint64_t> _cleared{0};
+            _slot _slots[capacity];
+        };
+
+        // the owner thread and its plain counter, empty for the other types
+        template <class AtomicType> struct _proxy_biased_counter {};
+        template <> struct _proxy_biased_counter<proxy_biased> {
+            _proxy_biased_owner* _owner = _proxy_biased_owner::local();
+            // only written by the owner, atomic to be read by the others
+            std::atomic<std::uint64_t> _local{0};
+        };
+
+        // 16 bytes state shared by all the proxies: the pin count and the
+        // flags live in the high bits of the refcount, so a single atomic
+        // operation sees all of them, and the deleter is reached through the
+        // type-erased function pointer of the owning states only.
+        // The proxy_biased states keep the references of the owner thread in
+        // a plain counter, and those of the other threads in the refcount
+        // bits, offset by shared_bias until the owner merges the two.
+        template <class AtomicType>
+        class _proxy_common_state_base
+            : public _proxy_biased_counter<AtomicType>,
+              public _proxy_state_stats<_proxy_records_enabled,
+                                        PROXY_PTR_STATS != 0> {
+           protected:
+            using ref_count_t = deduce_ref_count_type<AtomicType>;
+            static constexpr bool _is_atomic =
+                !std::is_same_v<AtomicType, proxy_non_atomic>;
+            static constexpr bool _is_biased =
+                std::is_same_v<AtomicType, proxy_biased>;
+
+            friend class _proxy_biased_owner;
+
+           public:
+            using bits_t = std::uint64_t;
+
+            // [63..53] flags, [52..40] pins, [39..0] refcount
+            static constexpr bits_t alive_flag = bits_t(1) << 63;
+            static constexpr bits_t weak_flag = alive_flag >> 1;
+            static constexpr bits_t pooled_flag = alive_flag >> 2;
+            static constexpr bits_t released_flag = alive_flag >> 3;
+            static constexpr bits_t embedded_flag = alive_flag >> 4;
+            static constexpr bits_t pending_flag = alive_flag >> 5;
+            static constexpr bits_t merged_flag = alive_flag >> 6;
+            static constexpr bits_t queued_flag = alive_flag >> 7;
+            static constexpr bits_t domain_flag = alive_flag >> 8;
+            static constexpr bits_t deferred_flag = alive_flag >> 9;
+            static constexpr bits_t expire_flag = alive_flag >> 10;
+            static constexpr bits_t pin_one = bits_t(1) << 40;
+            static constexpr bits_t pin_mask = (pin_one << 13) - pin_one;
+            static constexpr bits_t count_mask = pin_one - 1;
+            static constexpr bits_t shared_bias = pin_one >> 1;
+
+            // release: proxy_release() takes the object, the state may
+            // hand over another pointer through _ptr
+            enum class destroy_op { object, state, release };
+            using destroy_fn = void (*)(_proxy_common_state_base*, destroy_op);
+
+            _proxy_common_state_base(void* p, bits_t flags)
+                : _ptr(p), _bits(flags | alive_flag | _initial_bits()) {}
+
+            void inc_ref() {
+                _count(_proxy_stat::inc_ref);
+                _trace(_proxy_trace_op::copy);
+                if constexpr (_is_biased) {
+                    if (_owned())
+                        return _store_local(_load_local() + 1);
+                }
+                _fetch_add(1);
+            }
+            bool dec_ref() {
+                _count(_proxy_stat::dec_ref);
+                _trace(_proxy_trace_op::detach);
+                if constexpr (_is_biased) {
+                    if (!_owned())
+                        return _dec_shared();
+                    _store_local(_load_local() - 1);
+                    return _load_local() || _merge(false);
+                }
+                assert((_load() & count_mask) != 0);
+                return (_fetch_sub(1) & count_mask) != 1;
+            }
+
+            // takes a reference only if a proxy is still holding one
+            bool try_inc_ref() {
+                static_assert(!_is_biased);
+                auto bits = _load();
+                do {
+                    if (!(bits & count_mask))
+                        return false;
+                } while (!_compare_exchange(bits, bits + 1));
+                _count(_proxy_stat::inc_ref);
+                _trace(_proxy_trace_op::copy);
+                return true;
+            }
+
+            bool alive() const { return _alive(_load()); }
+            bool expired() const { return !alive(); }
+            bool is_weak() const { return (_load() & weak_flag) != 0; }
+            // proxy_biased: exact only when called by the owner thread
+            size_t use_count() const {
+                const auto bits = _load();
+                if constexpr (_is_biased) {
+                    if (!(bits & merged_flag))
+                        return static_cast<size_t>((bits & count_mask) +
+                                                   _load_local() - shared_bias);
+                }
+                return static_cast<size_t>(bits & count_mask);
+            }
+            void* get() const { return _ptr; }
+            // only the first release or delete hands the object over
+            void* release() {
+                auto bits = _load();
+                do {
+                    if (!(bits & alive_flag))
+                        return nullptr;
+                } while (!_compare_exchange(
+                    bits, (bits & ~alive_flag) | released_flag));
+
+                _count_expired(bits);
+                _trace(_proxy_trace_op::proxy_release);
+                if (bits & expire_flag)
+                    _fire_expire();
+                if (!(bits & weak_flag))
+                    _destroy_fn()(this, destroy_op::release);
+                return _ptr;
+            }
+
+            // flags the state for the expiration callbacks, it fails once
+            // the state is expired. Called with the table mutex held.
+            bool watch_expire() {
+                auto bits = _load();
+                do {
+                    if (!(bits & alive_flag))
+                        return false;
+                } while (!_compare_exchange(bits, bits | expire_flag));
+                return true;
+            }
+
+            // expires the proxies, the deleter waits for the pins to go away
+            void delete_ptr() {
+                _count(_proxy_stat::deletes);
+                _trace(_proxy_trace_op::proxy_delete);
+                _expire();
+            }
+
+            // a pin is a reference that also keeps the object from being
+            // deleted, it fails once the object is expired
+            bool pin() {
+                auto bits = _load();
+                do {
+                    if (!_alive(bits))
+                        return false;
+                    assert((bits & pin_mask) != pin_mask);
+                } while (!_compare_exchange(bits, bits + pin_one + 1));
+                _count(_proxy_stat::inc_ref);
+                _trace(_proxy_trace_op::copy);
+                return true;
+            }
+
+            void unpin() {
+                if constexpr (!_is_biased) {
+                    _count(_proxy_stat::dec_ref);
+                    _trace(_proxy_trace_op::detach);
+                }
+                // the biased reference may be released by the owner counter
+                const auto bits =
+                    _fetch_sub(_is_biased ? pin_one : pin_one + 1);
+                if ((bits & pin_mask) == pin_one && (bits & pending_flag)) {
+                    _fetch_and(~pending_flag);
+                    _delete_object();
+                }
+                if constexpr (_is_biased) {
+                    if (!dec_ref())
+                        destroy();
+                } else if ((bits & count_mask) == 1) {
+                    destroy();
+                }
+            }
+
+            // called by the last proxy_ptr detaching from the state
+            void destroy() {
+                _trace(_proxy_trace_op::last_detach);
+                // the embedded states only go away with their object
+                if (_load() & embedded_flag) {
+                    _count_freed(false);
+                    return _release_embedded();
+                }
+
+                _expire();
+                const auto bits = _load();
+                // a deferred deleter took a reference and owns the state now
+                if (bits & count_mask)
+                    return;
+                _count_freed(true);
+                if (!(bits & weak_flag))
+                    return _destroy_fn()(this, destroy_op::state);
+
+                static_assert(std::is_trivially_destructible_v<
+                              _proxy_common_state_base>);
+                if (bits & pooled_flag)
+                    deduce_pool_type<AtomicType>::instance().deallocate(
+                        this, _pool_class_of(sizeof(*this)));
+                else
+                    ::operator delete(this);
+            }
+
+           protected:
+            destroy_fn _destroy_fn() const;
+            void _release_embedded();
+            bool _domain_alive() const;
+
+            void _expire() {
+                auto bits = _load();
+                bits_t next;
+                do {
+                    if (!(bits & alive_flag))
+                        return;
+                    next = bits & ~alive_flag;
+                    if ((bits & pin_mask) && !(bits & weak_flag))
+                        next |= pending_flag;
+                } while (!_compare_exchange(bits, next));
+
+                _count_expired(next);
+                // the callbacks still see the object
+                if (next & expire_flag)
+                    _fire_expire();
+                if (!(next & (weak_flag | pending_flag)))
+                    _delete_object();
+            }
+
+            template <class Type, class State> void _stats_init(bool block) {
+                if constexpr (_proxy_records_enabled) {
+                    this->_stats = &_proxy_stats_of<Type, State>();
+                    if (block)
+                        _count(_proxy_stat::allocated);
+                    _trace(_proxy_trace_op::create);
+                }
+            }
+            void _count(_proxy_stat stat) {
+                if constexpr (PROXY_PTR_STATS != 0) {
+                    if (this->_stats)
+                        this->_stats->add(stat);
+                }
+            }
+            void _trace(_proxy_trace_op op) const {
+                if constexpr (PROXY_PTR_TRACE != 0) {
+                    if (auto ring = _proxy_trace_ring::local())
+                        ring->push(op, this,
+                                   this->_stats ? this->_stats->id : 0);
+                }
+            }
+            // the expired states still referenced are zombies until freed
+            void _count_expired(bits_t bits) {
+                if constexpr (PROXY_PTR_STATS != 0) {
+                    if (this->_stats && (bits & count_mask)) {
+                        this->_zombie.store(true, std::memory_order_relaxed);
+                        this->_stats->add(_proxy_stat::zombies);
+                    }
+                }
+            }
+            void _count_freed(bool block) {
+                if constexpr (PROXY_PTR_STATS != 0) {
+                    if (!this->_stats)
+                        return;
+                    if (block)
+                        this->_stats->add(_proxy_stat::freed);
+                    if (this->_zombie.exchange(false,
+                                               std::memory_order_relaxed))
+                        this->_stats->add(_proxy_stat::zombies_freed);
+                }
+            }
+
+            void _fire_expire() {
+                _proxy_expire_table<AtomicType>::instance().fire(this);
+            }
+
+            // the queue keeps a reference until the deleter runs
+            void _delete_object() {
+                if constexpr (std::is_same_v<AtomicType, proxy_non_atomic>) {
+                    if (_proxy_deletion_scope::open()) {
+                        inc_ref();
+                        return _proxy_deletion_scope::push(this,
+                                                           &_run_guarded);
+                    }
+                }
+                if (_load() & deferred_flag) {
+                    if (auto queue = _proxy_reclaim_queue::local()) {
+                        inc_ref();
+                        return queue->push(this, &_run_deferred);
+                    }
+                }
+                _destroy_fn()(this, destroy_op::object);
+            }
+
+            static void _run_deferred(void* ptr) {
+                auto state = static_cast<_proxy_common_state_base*>(ptr);
+                state->_destroy_fn()(state, destroy_op::object);
+                if (!state->dec_ref())
+                    state->destroy();
+            }
+
+            // the guard is closed, a deferred type is queued again
+            static void _run_guarded(void* ptr) {
+                auto state = static_cast<_proxy_common_state_base*>(ptr);
+                state->_delete_object();
+                if (!state->dec_ref())
+                    state->destroy();
+            }
+
+            // the states of a proxy_domain also expire with their domain
+            bool _alive(bits_t bits) const {
+                if (!(bits & alive_flag))
+                    return false;
+                return !(bits & domain_flag) || _domain_alive();
+            }
+
+            // the states created by a thread without owner record (i.e.
+            // while exiting) are merged from the start
+            bits_t _initial_bits() const {
+                if constexpr (_is_biased)
+                    return this->_owner ? shared_bias : merged_flag;
+                else
+                    return 0;
+            }
+
+            // only the owner thread sets merged_flag, so it can read it
+            // without ordering
+            bool _owned() const {
+                return this->_owner == _proxy_biased_owner::current() &&
+                       !(_bits.load(std::memory_order_relaxed) & merged_flag);
+            }
+            std::uint64_t _load_local() const {
+                return this->_local.load(std::memory_order_relaxed);
+            }
+            void _store_local(std::uint64_t v) {
+                this->_local.store(v, std::memory_order_relaxed);
+            }
+
+            // the reference of another thread: when the shared count goes
+            // below zero the state is queued to the owner, the only one who
+            // can tell whether the references are over
+            bool _dec_shared() {
+                auto bits = _load();
+                bits_t next;
+                do {
+                    next = bits - 1;
+                    if (!(bits & merged_flag) &&
+                        (next & count_mask) < shared_bias)
+                        next |= queued_flag;
+                } while (!_compare_exchange(bits, next));
+
+                // a queued state is destroyed by the owner flush()
+                if (next & merged_flag)
+                    return (next & (count_mask | queued_flag)) != 0;
+                if ((next & queued_flag) && !(bits & queued_flag))
+                    this->_owner->push(this);
+                return true;
+            }
+
+            // called by the owner thread: folds the plain counter into the
+            // shared one, so from now on every thread uses the latter
+            bool _merge(bool dequeue) {
+                auto bits = _load();
+                bits_t next;
+                do {
+                    next = dequeue ? bits & ~queued_flag : bits;
+                    if (!(bits & merged_flag))
+                        next = (next + _load_local() - shared_bias) |
+                               merged_flag;
+                } while (!_compare_exchange(bits, next));
+                _store_local(0);
+                return (next & (count_mask | queued_flag)) != 0;
+            }
+
+            bits_t _load() const {
+                if constexpr (_is_atomic)
+                    return _bits.load(std::memory_order_acquire);
+                else
+                    return _bits;
+            }
+            bits_t _fetch_add(bits_t v) {
+                if constexpr (_is_atomic)
+                    return _bits.fetch_add(v, std::memory_order_relaxed);
+                else
+                    return std::exchange(_bits, _bits + v);
+            }
+            bits_t _fetch_sub(bits_t v) {
+                if constexpr (_is_atomic)
+                    return _bits.fetch_sub(v, std::memory_order_acq_rel);
+                else
+                    return std::exchange(_bits, _bits - v);
+            }
+            bits_t _fetch_and(bits_t v) {
+                if constexpr (_is_atomic)
+                    return _bits.fetch_and(v, std::memory_order_acq_rel);
+                else
+                    return std::exchange(_bits, _bits & v);
+            }
+            bool _compare_exchange(bits_t& expected, bits_t desired) {
+                if constexpr (_is_atomic)
+                    return _bits.compare_exchange_weak(
+                        expected, desired, std::memory_order_acq_rel,
+                        std::memory_order_acquire);
+                else
+                    return (_bits = desired), true;
+            }
+
+            void* _ptr = nullptr;
+            ref_count_t _bits;
+        };
+
+    #if !PROXY_PTR_STATS && !PROXY_PTR_TRACE
+        static_assert(sizeof(_proxy_common_state_base<proxy_non_atomic>) ==
+                      16);
+        static_assert(sizeof(_proxy_common_state_base<proxy_atomic>) == 16);
+        static_assert(sizeof(_proxy_common_state_base<proxy_biased>) == 32);
+    #endif
+
+        // merges the states the other threads queued, returns their number
+        inline size_t _proxy_biased_owner::flush() {
+            std::vector<state_type*> queue;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                queue.swap(_queue);
+            }
+            for (auto state : queue) {
+                if (!state->_merge(true))
+                    state->destroy();
+            }
+            return queue.size();
+        }
+
+        // base of the states calling a deleter, it only adds the destroy_fn
+        template <class AtomicType>
+        class _proxy_owning_state_base
+            : public _proxy_common_state_base<AtomicType> {
+           public:
+            using base_type = _proxy_common_state_base<AtomicType>;
+
+            _proxy_owning_state_base(void* p,
+                                     typename base_type::destroy_fn fn,
+                                     typename base_type::bits_t flags = 0)
+                : base_type(p, flags), _destroy(fn) {}
+
+            typename base_type::destroy_fn _destroy;
+        };
+
+        template <class Type, class AtomicType>
+        constexpr std::uint64_t deferred_delete_flags =
+            proxy_deferred_delete<std::remove_cv_t<Type>>::value
+                ? _proxy_common_state_base<AtomicType>::deferred_flag
+                : 0;
+
+        template <class AtomicType>
+        typename _proxy_common_state_base<AtomicType>::destroy_fn
+        _proxy_common_state_base<AtomicType>::_destroy_fn() const {
+            using owning_type = _proxy_owning_state_base<AtomicType>;
+            return static_cast<const owning_type*>(this)->_destroy;
+        }
+
+        // base of the proxy_domain states: they are alive as long as the
+        // generation of their domain is the one they were created in
+        template <class AtomicType>
+        class _proxy_domain_state_base
+            : public _proxy_owning_state_base<AtomicType> {
+           public:
+            using owning_type = _proxy_owning_state_base<AtomicType>;
+            using base_type = _proxy_common_state_base<AtomicType>;
+            using generation_t = deduce_ref_count_type<AtomicType>;
+
+            _proxy_domain_state_base(void* p,
+                                     typename base_type::destroy_fn fn,
+                                     typename base_type::bits_t flags = 0)
+                : owning_type(p, fn, flags | base_type::domain_flag) {}
+
+            const generation_t* _domain_generation = nullptr;
+            std::uint64_t _generation = 0;
+        };
+
+        PROXY_PTR_DOWNCAST_BEGIN
+        template <class AtomicType>
+        bool _proxy_common_state_base<AtomicType>::_domain_alive() const {
+            using domain_type = _proxy_domain_state_base<AtomicType>;
+            auto state = static_cast<const domain_type*>(this);
+            if constexpr (_is_atomic)
+                return state->_domain_generation->load(
+                           std::memory_order_acquire) == state->_generation;
+            else
+                return *state->_domain_generation == state->_generation;
+        }
+        PROXY_PTR_DOWNCAST_END
+
+        template <class Type> struct non_deleter {
+            void operator()(Type* ptr) noexcept {}
+        };
+
+        // state of the proxy_parent_base proxies, it never deletes the object
+        template <class Type, class AtomicType>
+        class _proxy_weak_state
+            : public _proxy_common_state_base<AtomicType>,
+              public proxy_state_allocator<Type, AtomicType> {
+           public:
+            using base_type = _proxy_common_state_base<AtomicType>;
+
+            _proxy_weak_state(Type* ptr)
+                : base_type(ptr, base_type::weak_flag |
+                                     (proxy_use_pool<Type>::value
+                                          ? base_type::pooled_flag
+                                          : 0)) {
+                this->template _stats_init<Type, _proxy_weak_state>(true);
+            }
+        };
+
+        static_assert(
+            sizeof(_proxy_weak_state<int, proxy_non_atomic>) ==
+            sizeof(_proxy_common_state_base<proxy_non_atomic>));
+
+        template <class Type, class Dex, class AtomicType>
+        class _proxy_common_state
+            : private Dex,
+              public _proxy_owning_state_base<AtomicType>,
+              public proxy_state_allocator<Type, AtomicType> {
+           public:
+            using base_type = _proxy_common_state_base<AtomicType>;
+            using owning_type = _proxy_owning_state_base<AtomicType>;
+
+            _proxy_common_state(Type* ptr)
+                : owning_type(ptr, &_destroy, _flags) {
+                this->template _stats_init<Type, _proxy_common_state>(true);
+            }
+            _proxy_common_state(Type* ptr, const Dex& dx)
+                : Dex(dx), owning_type(ptr, &_destroy, _flags) {
+                this->template _stats_init<Type, _proxy_common_state>(true);
+            }
+
+           private:
+            static constexpr auto _flags =
+                deferred_delete_flags<Type, AtomicType>;
+
+            static void _destroy(base_type* base,
+                                 typename base_type::destroy_op op) {
+                auto state = static_cast<_proxy_common_state*>(base);
+                if (op == base_type::destroy_op::state)
+                    delete state;
+                else if (op == base_type::destroy_op::object && state->_ptr)
+                    static_cast<Dex&>(*state)(static_cast<Type*>(state->_ptr));
+            }
         };
 
-        template <class Ty>
-        using deduce_ref_count_type = typename _deduce_ref_count_type<Ty>::type;
+        struct _value_init_tag {};
+        struct _default_init_tag {};
+
+        // single allocation state used by make_proxy: the object lives inside
+        // the state, it's destroyed by delete_ptr() and its storage is freed
+        // together with the state when the last proxy_ptr detaches.
+        // proxy_release() moves the object out into a new Type the caller
+        // owns, a type that can't be moved gives nullptr and stays inside.
+        template <class Type, class AtomicType,
+                  class Base = _proxy_owning_state_base<AtomicType>>
+        class _proxy_inplace_state
+            : public Base,
+              public proxy_state_allocator<Type, AtomicType> {
+           public:
+            using base_type = _proxy_common_state_base<AtomicType>;
+
+            template <class... args>
+            _proxy_inplace_state(_value_init_tag tag, args&&... va)
+                : _proxy_inplace_state(&_destroy<_proxy_inplace_state>, tag,
+                                       std::forward<args>(va)...) {}
+            _proxy_inplace_state(_default_init_tag tag)
+                : _proxy_inplace_state(&_destroy<_proxy_inplace_state>, tag) {}
 
-        template <class AtomicType> class _proxy_common_state_base {
            protected:
-            using ref_count_t = deduce_ref_count_type<AtomicType>;
-            void* _ptr = nullptr;
-            ref_count_t _ref_count = static_cast<size_t>(0);
-            bool _alive = false;
+            using destroy_fn = typename base_type::destroy_fn;
 
-           public:
-            _proxy_common_state_base(void* p) : _ptr(p) { _alive = true; }
+            template <class... args>
+            _proxy_inplace_state(destroy_fn fn, _value_init_tag, args&&... va)
+                : Base(nullptr, fn, deferred_delete_flags<Type, AtomicType>) {
+                this->_ptr = ::new (static_cast<void*>(_storage))
+                    Type(std::forward<args>(va)...);
+                this->template _stats_init<Type, _proxy_inplace_state>(true);
+            }
+            _proxy_inplace_state(destroy_fn fn, _default_init_tag)
+                : Base(nullptr, fn, deferred_delete_flags<Type, AtomicType>) {
+                this->_ptr = ::new (static_cast<void*>(_storage)) Type;
+                this->template _stats_init<Type, _proxy_inplace_state>(true);
+            }
 
-            void inc_ref() { _ref_count++; }
-            bool dec_ref() {
-                if (_ref_count == 0)
-                    return false;
-                return --_ref_count != 0;
+            template <class State>
+            static void _destroy(base_type* base,
+                                 typename base_type::destroy_op op) {
+                auto state = static_cast<State*>(base);
+                auto object =
+                    std::launder(reinterpret_cast<Type*>(state->_storage));
+                if (op == base_type::destroy_op::object)
+                    return object->~Type();
+                if (op == base_type::destroy_op::release)
+                    return _move_out(state, object);
+
+                // a released object that couldn't be moved out
+                if ((state->_load() & base_type::released_flag) &&
+                    !state->_ptr)
+                    object->~Type();
+                delete state;
             }
 
-            bool alive() const { return _alive; }
-            bool expired() const { return !alive(); }
-            void* get() const { return _ptr; }
-            void* release() {
-                _alive = false;
-                return _ptr;
+            // the copy left inside goes away like a deleted object, so the
+            // epoch states still wait for their readers
+            template <class State>
+            static void _move_out(State* state, Type* object) {
+                state->_ptr = nullptr;
+                if constexpr (std::is_move_constructible_v<Type>) {
+                    auto moved = new std::remove_const_t<Type>(
+                        std::move(*const_cast<std::remove_const_t<Type>*>(
+                            object)));
+                    state->_ptr = moved;
+                    state->_destroy_fn()(state, base_type::destroy_op::object);
+                }
             }
 
-            virtual bool is_weak() const = 0;
-            virtual void delete_ptr() = 0;
-            virtual ~_proxy_common_state_base() {}
+           private:
+            alignas(Type) unsigned char _storage[sizeof(Type)];
         };
 
-        template <class Type> struct non_deleter {
-            void operator()(Type* ptr) noexcept {}
+        // put right before the object by the class operator new of
+        // proxy_intrusive_base, the key tells it apart from the memory
+        // preceding an object allocated otherwise
+        struct _proxy_tombstone_header {
+            static constexpr std::uintptr_t magic =
+                std::uintptr_t(0x9e3779b97f4a7c15ull);
+
+            std::uintptr_t key;
+            std::uint32_t align;
+            bool retained;
+
+            // from the start of the storage to the object
+            static size_t offset(size_t align) noexcept {
+                constexpr size_t base =
+                    std::max<size_t>(sizeof(_proxy_tombstone_header),
+                                     __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+                return std::max(base, align);
+            }
+
+            // align is 0 for the default alignment
+            static void* allocate(size_t size, size_t align) {
+                const auto skip = offset(align);
+                auto storage = static_cast<unsigned char*>(
+                    align ? ::operator new(size + skip, std::align_val_t(align))
+                          : ::operator new(size + skip));
+                auto object = storage + skip;
+                auto header = ::new (static_cast<void*>(
+                    object - sizeof(_proxy_tombstone_header)))
+                    _proxy_tombstone_header{0,
+                                            static_cast<std::uint32_t>(align),
+                                            false};
+                header->key = reinterpret_cast<std::uintptr_t>(header) ^ magic;
+                return object;
+            }
+
+            static _proxy_tombstone_header* of(void* object) noexcept {
+                return reinterpret_cast<_proxy_tombstone_header*>(
+                    static_cast<unsigned char*>(object) -
+                    sizeof(_proxy_tombstone_header));
+            }
+
+            // the header of an object allocated otherwise isn't ours, it's
+            // only read
+            static _proxy_tombstone_header* find(void* object) noexcept {
+                auto header = of(object);
+                if (header->key != (reinterpret_cast<std::uintptr_t>(header) ^
+                                    magic))
+                    return nullptr;
+                return header;
+            }
+
+            void deallocate() noexcept {
+                const auto skip = offset(align);
+                auto storage =
+                    reinterpret_cast<unsigned char*>(this + 1) - skip;
+                key = 0;
+                if (align)
+                    ::operator delete(storage, std::align_val_t(align));
+                else
+                    ::operator delete(storage);
+            }
         };
 
-        template <class Type, class Dex, class AtomicType>
-        class _proxy_common_state
-            : private Dex,
-              public _proxy_common_state_base<AtomicType> {
+        // state embedded in the proxy_intrusive_base objects: it never
+        // deletes the object, and when the object is destroyed while
+        // proxies are still around its storage is kept as tombstone until
+        // the last of them detaches
+        template <class AtomicType>
+        class _proxy_embedded_state
+            : public _proxy_common_state_base<AtomicType> {
            public:
-            _proxy_common_state(Type* ptr)
-                : _proxy_common_state_base<AtomicType>(ptr) {}
-            _proxy_common_state(Type* ptr, const Dex& dx)
-                : _proxy_common_state_base<AtomicType>(ptr) {
-                static_cast<Dex&>(*this) = dx;
+            using base_type = _proxy_common_state_base<AtomicType>;
+
+            _proxy_embedded_state()
+                : base_type(nullptr,
+                            base_type::weak_flag | base_type::embedded_flag) {}
+            _proxy_embedded_state(const _proxy_embedded_state&) = delete;
+            _proxy_embedded_state& operator=(const _proxy_embedded_state&) =
+                delete;
+
+            // the state isn't a separate allocation, so it isn't counted as
+            // a block by the PROXY_PTR_STATS counters. object is the start
+            // of the complete object, where the tombstone header is found.
+            template <class Type> void set(Type* ptr, void* object) {
+                _object = object;
+                if (this->_ptr)
+                    return;
+                this->_ptr = ptr;
+                this->template _stats_init<Type, _proxy_embedded_state>(false);
             }
 
-            bool is_weak() const override {
-                using WeakDeleter = detail::non_deleter<Type>;
-                return std::is_same_v<Dex, WeakDeleter>;
+            // called by the destructor of the object while proxies are left,
+            // the class operator delete leaves the storage to the state
+            void retain_storage() {
+                auto header = _proxy_tombstone_header::find(_object);
+                assert(header &&
+                       "a proxy_intrusive_base object not allocated with new "
+                       "was destroyed while proxies were left");
+                if (!header)
+                    return;
+                header->retained = true;
+                _tombstone = header;
             }
-            void delete_ptr() override {
-                if (this->_ptr && this->_alive) {
-                    static_cast<Dex&>(*this)(static_cast<Type*>(this->_ptr));
-                    this->_alive = false;
-                }
+
+            void release_storage() {
+                if (_tombstone)
+                    _tombstone->deallocate();
             }
-            virtual ~_proxy_common_state() { delete_ptr(); }
+
+           private:
+            void* _object = nullptr;
+            _proxy_tombstone_header* _tombstone = nullptr;
         };
 
+        PROXY_PTR_DOWNCAST_BEGIN
+        template <class AtomicType>
+        void _proxy_common_state_base<AtomicType>::_release_embedded() {
+            using embedded_type = _proxy_embedded_state<AtomicType>;
+            static_cast<embedded_type*>(this)->release_storage();
+        }
+        PROXY_PTR_DOWNCAST_END
+
         template <class Ty> struct _extract_proxy_pointer_type {
             using type = Ty*;
         };
@@ -145,6 +1716,68 @@ namespace proxy {
             std::is_same_v<Type1, std::remove_const_t<Type2>> ||
             std::is_same_v<Type2, std::remove_const_t<Type1>>;
 
+        // like std::shared_ptr, an array only converts to an array of the
+        // same elements with more cv-qualifiers, never to or from an object
+        template <class From, class To>
+        struct _proxy_convertible : std::is_convertible<From*, To*> {};
+        template <class From, class To>
+        struct _proxy_convertible<From[], To> : std::false_type {};
+        template <class From, class To>
+        struct _proxy_convertible<From, To[]> : std::false_type {};
+        template <class From, class To>
+        struct _proxy_convertible<From[], To[]>
+            : std::is_convertible<From (*)[], To (*)[]> {};
+
+        template <class From, class To>
+        constexpr bool is_proxy_convertible =
+            _proxy_convertible<From, To>::value;
+
+        // From* converts to To* without reading the object: the reverse
+        // cast is well-formed only when there's no virtual base between them
+        template <class From, class To, class = void>
+        constexpr bool is_proxy_offset_static = false;
+        template <class From, class To>
+        constexpr bool is_proxy_offset_static<
+            From, To,
+            std::void_t<decltype(static_cast<std::add_cv_t<From>*>(
+                std::declval<To*>()))>> = true;
+
+        template <class From, class To>
+        constexpr bool is_proxy_downcast =
+            std::is_base_of_v<From, To> &&
+            !std::is_same_v<std::remove_cv_t<From>, std::remove_cv_t<To>>;
+
+        // a downcast doesn't read the object through a non virtual base, but
+        // it must not be applied to an expired one: the offset of the base
+        // is taken on a made up address and applied by hand
+        template <class Derived, class Base>
+        Derived* _proxy_static_downcast(Base* ptr) noexcept {
+            static_assert(
+                std::is_same_v<decltype(static_cast<Derived*>(ptr)), Derived*>);
+            if (!ptr)
+                return nullptr;
+            const auto probe = std::uintptr_t(alignof(Derived)) << 16;
+            using derived_type = const volatile Derived;
+            using base_type = const volatile Base;
+            const auto base = reinterpret_cast<std::uintptr_t>(
+                static_cast<base_type*>(
+                    reinterpret_cast<derived_type*>(probe)));
+            return reinterpret_cast<Derived*>(
+                reinterpret_cast<std::uintptr_t>(ptr) - (base - probe));
+        }
+
+        // the implicit conversions of proxy_ptr and proxy_ref: a virtual
+        // base is found through the object, so like static_pointer_cast an
+        // expired one converts to nullptr instead of reading a dead vptr
+        template <class To, class Proxy>
+        To* _proxy_upcast(const Proxy& r) noexcept {
+            using From = typename Proxy::Type;
+            if constexpr (is_proxy_offset_static<From, To>)
+                return r.hashkey();
+            else
+                return r.get();
+        }
+
         template <class Ty>
         constexpr bool is_proxy_valid_type =
             !PROXY_PTR_IS_ARRAY(Ty) ||
@@ -158,13 +1791,100 @@ namespace proxy {
         template <class Ty>
         constexpr bool is_valid_atomic_flag =
             std::is_same<Ty, proxy_atomic>::value ||
-            std::is_same<Ty, proxy_non_atomic>::value;
+            std::is_same<Ty, proxy_non_atomic>::value ||
+            std::is_same<Ty, proxy_biased>::value;
 
         template <class Ty>
         using enable_valid_atomic_flag =
             std::enable_if_t<is_valid_atomic_flag<Ty>>;
+
+        // forward declaration
+        template <class Ty, class Atomic> struct make_proxy;
+
+        // lets the other headers wrap a state into a proxy_ptr
+        struct _proxy_access {
+            template <class Proxy, class State>
+            static Proxy make(State* state) {
+                return Proxy{
+                    static_cast<typename Proxy::_common_PtrType*>(state)};
+            }
+            template <class Proxy, class State, class Type>
+            static Proxy make(State* state, Type* ptr) {
+                return Proxy{
+                    static_cast<typename Proxy::_common_PtrType*>(state), ptr};
+            }
+            // the state must be pinned already
+            template <class Pin, class State, class Type>
+            static Pin make_pin(State* state, Type* ptr) {
+                return Pin{state, ptr};
+            }
+        };
     }  // namespace detail
 
+    // scoped guard returned by proxy_ptr::pin(): while it's around the
+    // object can't be deleted, a proxy_delete() only expires the proxies
+    // and the deleter runs when the last pin goes away
+    template <class _RTy, class AtomicTypeFlag = proxy_non_atomic>
+    class proxy_pin {
+       public:
+        using Type = detail::extract_proxy_type<_RTy>;
+        using _common_PtrType =
+            detail::_proxy_common_state_base<AtomicTypeFlag>;
+
+        proxy_pin() noexcept = default;
+        proxy_pin(proxy_pin&& r) noexcept
+            : _ppobj(std::exchange(r._ppobj, nullptr)),
+              _ptr(std::exchange(r._ptr, nullptr)) {}
+        proxy_pin& operator=(proxy_pin&& r) noexcept {
+            proxy_pin(std::move(r)).swap(*this);
+            return *this;
+        }
+        ~proxy_pin() {
+            if (_ppobj)
+                _ppobj->unpin();
+        }
+
+        explicit operator bool() const noexcept { return _ptr != nullptr; }
+        Type* get() const noexcept { return _ptr; }
+
+        template <class Type2 = _RTy,
+                  class = std::enable_if_t<!PROXY_PTR_IS_ARRAY(Type2)>>
+        Type* operator->() const noexcept {
+            assert(_ptr);
+            return _ptr;
+        }
+
+        template <class Type2 = _RTy,
+                  class = std::enable_if_t<!PROXY_PTR_IS_ARRAY(Type2)>>
+        Type& operator*() const noexcept {
+            assert(_ptr);
+            return *_ptr;
+        }
+
+        template <class Type2 = _RTy,
+                  class = std::enable_if_t<PROXY_PTR_IS_ARRAY(Type2)>>
+        Type& operator[](std::ptrdiff_t p) const noexcept {
+            assert(_ptr);
+            return _ptr[p];
+        }
+
+        void swap(proxy_pin& r) noexcept {
+            std::swap(_ppobj, r._ppobj);
+            std::swap(_ptr, r._ptr);
+        }
+
+       private:
+        template <class, class, class> friend class proxy_ptr;
+        template <class, class> friend class proxy_ref;
+        friend struct detail::_proxy_access;
+
+        proxy_pin(_common_PtrType* state, Type* ptr) noexcept
+            : _ppobj(state), _ptr(ptr) {}
+
+        _common_PtrType* _ppobj = nullptr;
+        Type* _ptr = nullptr;
+    };
+
     template <class _RTy, class AtomicTypeFlag = proxy_non_atomic,
               class = detail::enable_valid_atomic_flag<AtomicTypeFlag>>
     class proxy_ptr {
@@ -178,38 +1898,67 @@ namespace proxy {
         }
 
        protected:
-        proxy_ptr(_common_PtrType* _ptr) {
-            _ppobj = _ptr;
-            if (_ppobj)
+        template <class, class> friend struct detail::make_proxy;
+        template <class, class, class> friend class proxy_ptr;
+        template <class> friend class proxy_intrusive_base;
+        friend struct detail::_proxy_access;
+
+        // the state must hold a Type, the pointer is taken from it
+        proxy_ptr(_common_PtrType* state)
+            : proxy_ptr(state,
+                        state ? static_cast<Type*>(state->get()) : nullptr) {}
+        proxy_ptr(_common_PtrType* state, Type* ptr) : _ppobj(state) {
+            if (_ppobj) {
                 _ppobj->inc_ref();
+                _ptr = ptr;
+            }
         }
 
        public:
         proxy_ptr() {}
         proxy_ptr(std::nullptr_t) {}
         proxy_ptr(const proxy_ptr& n) { _proxy_from(n); }
+        proxy_ptr(proxy_ptr&& n) noexcept
+            : _ppobj(std::exchange(n._ppobj, nullptr)),
+              _ptr(std::exchange(n._ptr, nullptr)) {}
+        template <class Type2,
+                  std::enable_if_t<detail::is_proxy_convertible<Type2, _RTy>,
+                                   int> = 0>
+        proxy_ptr(proxy_ptr<Type2, AtomicTypeFlag>&& n) noexcept
+            : _ptr(detail::_proxy_upcast<Type>(n)) {
+            _ppobj = std::exchange(n._ppobj, nullptr);
+            n._ptr = nullptr;
+        }
         explicit proxy_ptr(Type* r) {
-            using deleter_type = std::default_delete<Type>;
+            using deleter_type = std::default_delete<_RTy>;
             using common_ptr_type =
                 detail::_proxy_common_state<Type, deleter_type, AtomicTypeFlag>;
-            _detach(new common_ptr_type(r));
+            _detach(new common_ptr_type(r), r);
         }
         template <class Dex, std::enable_if_t<
                                  detail::is_valid_deleter<Type, Dex>, int> = 0>
         explicit proxy_ptr(Type* r, const Dex& dx) {
-            using common_ptr_type =
-                detail::_proxy_common_state<Type, Dex, AtomicTypeFlag>;
-            _detach(new common_ptr_type(r, dx));
+            constexpr bool is_weak =
+                std::is_same_v<Dex, detail::non_deleter<Type>>;
+            if PROXY_PTR_CONSTEXPR (is_weak) {
+                using common_ptr_type =
+                    detail::_proxy_weak_state<Type, AtomicTypeFlag>;
+                _detach(new common_ptr_type(r), r);
+            } else {
+                using common_ptr_type =
+                    detail::_proxy_common_state<Type, Dex, AtomicTypeFlag>;
+                _detach(new common_ptr_type(r, dx), r);
+            }
         }
 
-        template <
-            class Type2,
-            std::enable_if_t<detail::is_proxy_valid_cast<Type, Type2>, int> = 0>
+        // aliasing: shares the state of other but get() returns ptr, e.g. a
+        // base subobject or a member of the object. It's what the casts use,
+        // so the adjusted pointer is kept also across multiple and virtual
+        // inheritance. An empty other makes an empty proxy.
+        template <class Type2>
         explicit proxy_ptr(Type* ptr,
                            const proxy_ptr<Type2, AtomicTypeFlag>& other) {
-            // assert(other._is_Pointing());
-            PROXY_PTR_UNUSED(ptr);
-            _detach(other._state());
+            _detach(other._state(), other._state() ? ptr : nullptr);
         }
 
         explicit operator bool() const { return alive(); }
@@ -251,13 +2000,15 @@ namespace proxy {
             return !(_Right < *this);
         }
 
-        Type* hashkey() const {
-            if (!_is_Pointing())
-                return nullptr;
-            return static_cast<Type*>(_ppobj->get());
-        }
+        // the object pointer is cached next to the state, only the alive
+        // check has to look into it
+        Type* hashkey() const { return _ptr; }
 
-        Type* get() const { return alive() ? hashkey() : nullptr; }
+        Type* get() const { return alive() ? _ptr : nullptr; }
+
+        // no alive check: the object must be known to be there, e.g. in a
+        // proxy_deletion_guard scope after alive() returned true
+        Type* get_unchecked() const noexcept { return _ptr; }
 
         template <class Type2 = Type,
                   class = std::enable_if_t<!PROXY_PTR_IS_ARRAY(Type2)>>
@@ -266,11 +2017,11 @@ namespace proxy {
             return get();
         }
 
-        template <class Type2 = Type,
+        template <class Type2 = _RTy,
                   class = std::enable_if_t<PROXY_PTR_IS_ARRAY(Type2)>>
-        Type2& operator[](std::ptrdiff_t p) const {
+        Type& operator[](std::ptrdiff_t p) const {
             assert(_is_Pointing() && alive());
-            return (*get())[p];
+            return get()[p];
         }
 
         template <class Type2 = Type,
@@ -281,7 +2032,21 @@ namespace proxy {
         }
 
         decltype(auto) operator=(const proxy_ptr<Type, AtomicTypeFlag>& r) {
-            _detach(r._ppobj);
+            _proxy_from(r);
+            return (*this);
+        }
+
+        decltype(auto) operator=(proxy_ptr<Type, AtomicTypeFlag>&& r) noexcept {
+            proxy_ptr(std::move(r)).swap(*this);
+            return (*this);
+        }
+
+        template <class Type2,
+                  std::enable_if_t<detail::is_proxy_convertible<Type2, _RTy>,
+                                   int> = 0>
+        decltype(auto) operator=(
+            proxy_ptr<Type2, AtomicTypeFlag>&& r) noexcept {
+            proxy_ptr(std::move(r)).swap(*this);
             return (*this);
         }
 
@@ -290,10 +2055,19 @@ namespace proxy {
             return (*this);
         }
 
+        // a make_proxy object is moved out of its block, the adjusted
+        // pointer keeps its offset into the object
         Type* proxy_release() {
             if (!_is_Pointing())
                 return nullptr;
-            return static_cast<Type*>(_ppobj->release());
+            const auto before = _ppobj->get();
+            const auto after = _ppobj->release();
+            if (!after || after == before)
+                return after ? _ptr : nullptr;
+            const auto offset = reinterpret_cast<std::uintptr_t>(_ptr) -
+                                reinterpret_cast<std::uintptr_t>(before);
+            return reinterpret_cast<Type*>(
+                reinterpret_cast<std::uintptr_t>(after) + offset);
         }
 
         void proxy_delete() {
@@ -301,135 +2075,573 @@ namespace proxy {
                 _ppobj->delete_ptr();
         }
 
+        // _ptr is null also for a null object or an aliasing/cast to null
         bool alive() const {
-            return _is_Pointing() && _ppobj->alive() && _ppobj->get();
+            return _is_Pointing() && _ppobj->alive() && _ptr;
         }
 
         bool expired() const { return !alive(); }
 
+        // an empty guard if the object is already expired
+        PROXY_PTR_NO_DISCARD proxy_pin<_RTy, AtomicTypeFlag> pin() const {
+            if (_ptr && _ppobj->pin())
+                return {_ppobj, _ptr};
+            return {};
+        }
+        PROXY_PTR_NO_DISCARD proxy_pin<_RTy, AtomicTypeFlag> lock() const {
+            return pin();
+        }
+
         bool _is_weakref() const { return _ppobj && _ppobj->is_weak(); }
 
+        void swap(proxy_ptr& r) noexcept {
+            std::swap(_ppobj, r._ppobj);
+            std::swap(_ptr, r._ptr);
+        }
+
         ~proxy_ptr() { _detach(); }
 
        protected:
         void _proxy_from(const proxy_ptr& n) {
-            if (n._ppobj == _ppobj)
+            if (n._ppobj == _ppobj) {
+                _ptr = n._ptr;
                 return;
-            _detach(n._ppobj);
+            }
+            _detach(n._ppobj, n._ptr);
         }
         bool _is_Pointing() const { return _ppobj != nullptr; }
-        void _detach(_common_PtrType* n = nullptr) {
+        void _detach(_common_PtrType* n = nullptr, Type* ptr = nullptr) {
             if (_ppobj)
                 if (!_ppobj->dec_ref())
-                    delete (_ppobj);
+                    _ppobj->destroy();
 
             _ppobj = n;
+            _ptr = ptr;
             if (_ppobj)
                 _ppobj->inc_ref();
         }
 
        private:
         _common_PtrType* _ppobj = nullptr;
+        Type* _ptr = nullptr;
+    };
+
+    template <class Type, class AtomicType>
+    void swap(proxy_ptr<Type, AtomicType>& _Left,
+              proxy_ptr<Type, AtomicType>& _Right) noexcept {
+        _Left.swap(_Right);
+    }
+
+    // borrowed view of a proxy_ptr: it shares the state without holding a
+    // reference, so passing it around costs nothing. Like a string_view it
+    // must not outlive the proxy_ptr it was made from, use proxy() to keep it.
+    template <class _RTy, class AtomicTypeFlag = proxy_non_atomic>
+    class proxy_ref {
+       public:
+        using Type = detail::extract_proxy_type<_RTy>;
+        using _common_PtrType =
+            detail::_proxy_common_state_base<AtomicTypeFlag>;
+
+        constexpr proxy_ref() noexcept = default;
+        constexpr proxy_ref(std::nullptr_t) noexcept {}
+        template <class Type2,
+                  std::enable_if_t<detail::is_proxy_convertible<Type2, _RTy>,
+                                   int> = 0>
+        proxy_ref(const proxy_ptr<Type2, AtomicTypeFlag>& r) noexcept
+            : _ppobj(r._state()), _ptr(detail::_proxy_upcast<Type>(r)) {}
+        template <class Type2,
+                  std::enable_if_t<detail::is_proxy_convertible<Type2, _RTy>,
+                                   int> = 0>
+        proxy_ref(const proxy_ref<Type2, AtomicTypeFlag>& r) noexcept
+            : _ppobj(r._state()), _ptr(detail::_proxy_upcast<Type>(r)) {}
+
+        explicit operator bool() const { return alive(); }
+
+        Type* hashkey() const { return _ptr; }
+
+        Type* get() const { return alive() ? _ptr : nullptr; }
+        Type* get_unchecked() const noexcept { return _ptr; }
+
+        template <class Type2 = Type,
+                  class = std::enable_if_t<!PROXY_PTR_IS_ARRAY(Type2)>>
+        Type2* operator->() const {
+            assert(alive());
+            return get();
+        }
+
+        template <class Type2 = _RTy,
+                  class = std::enable_if_t<PROXY_PTR_IS_ARRAY(Type2)>>
+        Type& operator[](std::ptrdiff_t p) const {
+            assert(alive());
+            return get()[p];
+        }
+
+        template <class Type2 = Type,
+                  class = std::enable_if_t<!PROXY_PTR_IS_ARRAY(Type2)>>
+        Type2& operator*() const {
+            assert(alive());
+            return *get();
+        }
+
+        bool alive() const { return _ppobj && _ppobj->alive() && _ptr; }
+        bool expired() const { return !alive(); }
+
+        void proxy_delete() const {
+            if (_ppobj)
+                _ppobj->delete_ptr();
+        }
+
+        // takes a reference, for the callee storing it
+        proxy_ptr<_RTy, AtomicTypeFlag> proxy() const {
+            return detail::_proxy_access::make<
+                proxy_ptr<_RTy, AtomicTypeFlag>>(_ppobj, _ptr);
+        }
+
+        PROXY_PTR_NO_DISCARD proxy_pin<_RTy, AtomicTypeFlag> pin() const {
+            if (_ptr && _ppobj->pin())
+                return {_ppobj, _ptr};
+            return {};
+        }
+
+        template <class Type2, class AtomicType2>
+        PROXY_PTR_NO_DISCARD bool operator==(
+            const proxy_ref<Type2, AtomicType2>& _Right) const noexcept {
+            return hashkey() == _Right.hashkey();
+        }
+        template <class Type2, class AtomicType2>
+        PROXY_PTR_NO_DISCARD bool operator!=(
+            const proxy_ref<Type2, AtomicType2>& _Right) const noexcept {
+            return !(*this == _Right);
+        }
+
+        _common_PtrType* _state() const { return _ppobj; }
+
+       private:
+        _common_PtrType* _ppobj = nullptr;
+        Type* _ptr = nullptr;
+    };
+
+    // expiration callback owned by an observer (a container entry, a timer):
+    // callback(context) fires once when the proxies it's attached to
+    // expire, through proxy_delete(), proxy_release() or the destruction of
+    // a proxy_parent_base/proxy_intrusive_base object, before the deleter
+    // runs. The hook detaches itself when destroyed, and the states that
+    // never get one don't pay anything.
+    template <class AtomicTypeFlag = proxy_non_atomic>
+    class proxy_expire_hook : private detail::_proxy_expire_node {
+        using table_type = detail::_proxy_expire_table<AtomicTypeFlag>;
+
+       public:
+        using callback_type = detail::_proxy_expire_node::callback_type;
+
+        proxy_expire_hook() = default;
+        proxy_expire_hook(const proxy_expire_hook&) = delete;
+        proxy_expire_hook& operator=(const proxy_expire_hook&) = delete;
+        ~proxy_expire_hook() { detach(); }
+
+        // an already expired proxy runs the callback right away and
+        // returns false
+        template <class Type2>
+        bool attach(proxy_ref<Type2, AtomicTypeFlag> ptr,
+                    callback_type _callback, void* _context) {
+            detach();
+            auto target = ptr._state();
+            if (!target)
+                return false;
+
+            auto& table = table_type::instance();
+            {
+                std::lock_guard<typename table_type::mutex_type> lock(
+                    table.mutex());
+                callback = _callback;
+                context = _context;
+                state = target;
+                table.link(this);
+                if (target->watch_expire())
+                    return true;
+                table.unlink(this);
+            }
+            _callback(_context);
+            return false;
+        }
+        template <class Type2>
+        bool attach(const proxy_ptr<Type2, AtomicTypeFlag>& ptr,
+                    callback_type _callback, void* _context) {
+            return attach(proxy_ref<Type2, AtomicTypeFlag>(ptr), _callback,
+                          _context);
+        }
+
+        void detach() {
+            auto& table = table_type::instance();
+            std::lock_guard<typename table_type::mutex_type> lock(
+                table.mutex());
+            if (state)
+                table.unlink(this);
+        }
+
+        bool attached() const {
+            auto& table = table_type::instance();
+            std::lock_guard<typename table_type::mutex_type> lock(
+                table.mutex());
+            return state != nullptr;
+        }
     };
 
-    template <class T, class U>
-    proxy::proxy_ptr<T> static_pointer_cast(
-        const proxy::proxy_ptr<U>& r) noexcept;
+    template <class T, class U, class A>
+    proxy_ptr<T, A> static_pointer_cast(const proxy_ptr<U, A>& r) noexcept;
 
-    template <class T, class U>
-    proxy::proxy_ptr<T> dynamic_pointer_cast(
-        const proxy::proxy_ptr<U>& r) noexcept;
+    template <class T, class U, class A>
+    proxy_ptr<T, A> dynamic_pointer_cast(const proxy_ptr<U, A>& r) noexcept;
 
-    template <class T, class U>
-    proxy::proxy_ptr<T> const_pointer_cast(
-        const proxy::proxy_ptr<U>& r) noexcept;
+    template <class T, class U, class A>
+    proxy_ptr<T, A> const_pointer_cast(const proxy_ptr<U, A>& r) noexcept;
 
-    template <class T, class U>
-    proxy::proxy_ptr<T> reinterpret_pointer_cast(
-        const proxy::proxy_ptr<U>& r) noexcept;
+    template <class T, class U, class A>
+    proxy_ptr<T, A> reinterpret_pointer_cast(const proxy_ptr<U, A>& r) noexcept;
 
     template <class Type> class proxy_parent_base {
        public:
-        proxy_ptr<Type> proxy() { return {_proxyPtr}; }
-        proxy_ptr<Type> proxy_from_this() { return {_proxyPtr}; }
+        proxy_parent_base() = default;
+        // the proxies belong to the object they were generated from
+        proxy_parent_base(const proxy_parent_base&) {}
+        proxy_parent_base& operator=(const proxy_parent_base&) {
+            return *this;
+        }
+
+        proxy_ptr<Type> proxy() { return {_proxy_state()}; }
+        proxy_ptr<Type> proxy_from_this() { return {_proxy_state()}; }
         template <class Derived> proxy_ptr<Derived> proxy_from_base() {
-            return {proxy::static_pointer_cast<Derived>(_proxyPtr)};
+            return {proxy::static_pointer_cast<Derived>(_proxy_state())};
         }
         void proxy_delete() {
-            auto ret = _proxyPtr.proxy_release();
-            _proxyPtr = static_cast<Type*>(this);
+            // the next proxy() will generate a new state
+            _proxyPtr.proxy_release();
+            _proxyPtr = nullptr;
         }
         virtual ~proxy_parent_base() { _proxyPtr.proxy_delete(); }
 
        private:
-        proxy_ptr<Type> _proxyPtr{static_cast<Type*>(this),
-                                  detail::non_deleter<Type>()};
+        // the state is generated the first time a proxy is requested
+        const proxy_ptr<Type>& _proxy_state() {
+            if (!_proxyPtr._state())
+                _proxyPtr = proxy_ptr<Type>{static_cast<Type*>(this),
+                                            detail::non_deleter<Type>()};
+            return _proxyPtr;
+        }
+
+        proxy_ptr<Type> _proxyPtr;
+    };
+
+    // like proxy_parent_base but the state is embedded in the object, so
+    // generating a proxy never allocates. If the object is deleted while
+    // proxies are still around, its storage is kept until the last of them
+    // detaches: objects not allocated with new must not outlive their
+    // proxies. proxy_delete() expires the proxies for good.
+    template <class Type> class proxy_intrusive_base {
+       public:
+        proxy_intrusive_base() = default;
+        // the proxies belong to the object they were generated from
+        proxy_intrusive_base(const proxy_intrusive_base&) {}
+        proxy_intrusive_base& operator=(const proxy_intrusive_base&) {
+            return *this;
+        }
+
+        proxy_ptr<Type> proxy() { return {_proxy_state()}; }
+        proxy_ptr<Type> proxy_from_this() { return {_proxy_state()}; }
+        template <class Derived> proxy_ptr<Derived> proxy_from_base() {
+            return {proxy::static_pointer_cast<Derived>(_proxy_state())};
+        }
+        void proxy_delete() { _state.delete_ptr(); }
+
+        // the state outlives the object while proxies are left, so its
+        // stores must reach the storage
+        virtual ~proxy_intrusive_base() {
+            _state.delete_ptr();
+            if (_state.use_count())
+                _state.retain_storage();
+            PROXY_PTR_KEEP_STORES();
+        }
+
+        // the storage starts with a tombstone header, see
+        // _proxy_embedded_state::retain_storage()
+        static void* operator new(size_t size) {
+            return detail::_proxy_tombstone_header::allocate(size, 0);
+        }
+        static void* operator new(size_t size, std::align_val_t al) {
+            return detail::_proxy_tombstone_header::allocate(
+                size, static_cast<size_t>(al));
+        }
+        static void operator delete(void* ptr) { _deallocate(ptr); }
+        static void operator delete(void* ptr, std::align_val_t) {
+            _deallocate(ptr);
+        }
+
+       private:
+        // the complete object is known only once it's constructed, so it's
+        // taken again by every proxy()
+        proxy_ptr<Type> _proxy_state() {
+            _state.set(static_cast<Type*>(this), dynamic_cast<void*>(this));
+            return proxy_ptr<Type>{&_state};
+        }
+
+        static void _deallocate(void* ptr) {
+            if (!ptr)
+                return;
+            auto header = detail::_proxy_tombstone_header::of(ptr);
+            if (!header->retained)
+                header->deallocate();
+        }
+
+        detail::_proxy_embedded_state<proxy_non_atomic> _state;
     };
 
     namespace detail {
         template <class Ty, class Atomic> struct make_proxy {
             template <class... args>
-            static proxy_ptr<Ty, Atomic> construct(const args&... va) {
-                return proxy_ptr<Ty, Atomic>{new Ty(va...)};
+            static proxy_ptr<Ty, Atomic> construct(args&&... va) {
+                using common_ptr_type = _proxy_inplace_state<Ty, Atomic>;
+                return proxy_ptr<Ty, Atomic>{
+                    static_cast<_proxy_common_state_base<Atomic>*>(
+                        new common_ptr_type(_value_init_tag{},
+                                            std::forward<args>(va)...))};
+            }
+
+            static proxy_ptr<Ty, Atomic> construct_for_overwrite() {
+                using common_ptr_type = _proxy_inplace_state<Ty, Atomic>;
+                return proxy_ptr<Ty, Atomic>{
+                    static_cast<_proxy_common_state_base<Atomic>*>(
+                        new common_ptr_type(_default_init_tag{}))};
             }
         };
 
+        // the arrays stay default-initialized like they always were, the
+        // callers of make_proxy<T[]> fill the buffers themselves
         template <class Ty, class Atomic> struct make_proxy<Ty[], Atomic> {
             static proxy_ptr<Ty[], Atomic> construct(size_t len) {
                 return proxy_ptr<Ty[], Atomic>{new Ty[len]};
             }
+
+            static proxy_ptr<Ty[], Atomic> construct_for_overwrite(
+                size_t len) {
+                return proxy_ptr<Ty[], Atomic>{new Ty[len]};
+            }
         };
     }  // namespace detail
 
     template <class Ty, class... Args>
     std::enable_if_t<detail::is_proxy_valid_type<Ty>, proxy_ptr<Ty>> make_proxy(
-        const Args&... Arguments) {
+        Args&&... Arguments) {
         return detail::make_proxy<Ty, proxy_non_atomic>::construct(
-            Arguments...);
+            std::forward<Args>(Arguments)...);
+    }
+
+    template <class Ty, class... Args>
+    std::enable_if_t<detail::is_proxy_valid_type<Ty>,
+                     proxy_ptr<Ty, proxy_atomic>>
+    make_proxy_atomic(Args&&... Arguments) {
+        return detail::make_proxy<Ty, proxy_atomic>::construct(
+            std::forward<Args>(Arguments)...);
+    }
+
+    // proxy_biased: copies made by the thread calling it are plain
+    // increments, see proxy_biased_flush()
+    template <class Ty, class... Args>
+    std::enable_if_t<detail::is_proxy_valid_type<Ty>,
+                     proxy_ptr<Ty, proxy_biased>>
+    make_proxy_biased(Args&&... Arguments) {
+        return detail::make_proxy<Ty, proxy_biased>::construct(
+            std::forward<Args>(Arguments)...);
+    }
+
+    // like make_proxy but the object is default-initialized
+    template <class Ty, class... Args>
+    std::enable_if_t<detail::is_proxy_valid_type<Ty>, proxy_ptr<Ty>>
+    make_proxy_for_overwrite(Args&&... Arguments) {
+        return detail::make_proxy<Ty, proxy_non_atomic>::
+            construct_for_overwrite(std::forward<Args>(Arguments)...);
     }
 
     template <class Ty, class... Args>
     std::enable_if_t<detail::is_proxy_valid_type<Ty>,
                      proxy_ptr<Ty, proxy_atomic>>
-    make_proxy_atomic(const Args&... Arguments) {
-        return detail::make_proxy<Ty, proxy_atomic>::construct(Arguments...);
+    make_proxy_atomic_for_overwrite(Args&&... Arguments) {
+        return detail::make_proxy<Ty, proxy_atomic>::construct_for_overwrite(
+            std::forward<Args>(Arguments)...);
     }
 
     template <class Type, class AtomicType> struct proxy_factory {
         template <class... args>
-        static proxy::proxy_ptr<Type, AtomicType> make(const args&... arg) {
-            return detail::make_proxy<Type, AtomicType>::construct(arg...);
+        static proxy::proxy_ptr<Type, AtomicType> make(args&&... arg) {
+            return detail::make_proxy<Type, AtomicType>::construct(
+                std::forward<args>(arg)...);
+        }
+
+        template <class... args>
+        static proxy::proxy_ptr<Type, AtomicType> make_for_overwrite(
+            args&&... arg) {
+            return detail::make_proxy<Type, AtomicType>::
+                construct_for_overwrite(std::forward<args>(arg)...);
+        }
+    };
+
+    // in_use/pooled blocks of the pool used by AtomicType, the
+    // proxy_non_atomic pool is the one of the calling thread
+    template <class AtomicType = proxy_non_atomic>
+    proxy_pool_stats get_proxy_pool_stats() {
+        return detail::deduce_pool_type<AtomicType>::instance().stats();
+    }
+
+    namespace detail {
+        inline void _proxy_stats_merge(proxy_type_stats& to,
+                                       const proxy_type_stats& from) {
+            to.allocated += from.allocated;
+            to.freed += from.freed;
+            to.live += from.live;
+            to.live_bytes += from.live_bytes;
+            to.inc_ref += from.inc_ref;
+            to.dec_ref += from.dec_ref;
+            to.proxy_delete += from.proxy_delete;
+            to.zombies += from.zombies;
+            to.zombie_bytes += from.zombie_bytes;
+        }
+    }  // namespace detail
+
+    // snapshot of the PROXY_PTR_STATS counters, one entry per type and a
+    // total. The refcount traffic is counted on the control blocks, so it
+    // belongs to the type the block was created for. Empty without
+    // PROXY_PTR_STATS.
+    inline proxy_stats_snapshot stats() {
+        using detail::_proxy_stat;
+        proxy_stats_snapshot ret;
+        ret.total.name = "total";
+        // the records also name the PROXY_PTR_TRACE types
+        if (!proxy_stats_enabled)
+            return ret;
+        auto record = detail::_proxy_stats_record::head().load();
+        for (; record; record = record->next) {
+            proxy_type_stats entry;
+            entry.name = record->name;
+            // the counters are read one at a time while other threads
+            // update them, the differences can't go below zero
+            entry.freed = record->get(_proxy_stat::freed);
+            entry.allocated =
+                std::max(entry.freed, record->get(_proxy_stat::allocated));
+            entry.live = entry.allocated - entry.freed;
+            entry.live_bytes = entry.live * record->block_size;
+            entry.inc_ref = record->get(_proxy_stat::inc_ref);
+            entry.dec_ref = record->get(_proxy_stat::dec_ref);
+            entry.proxy_delete = record->get(_proxy_stat::deletes);
+            const auto zombies_freed = record->get(_proxy_stat::zombies_freed);
+            entry.zombies =
+                std::max(zombies_freed, record->get(_proxy_stat::zombies)) -
+                zombies_freed;
+            entry.zombie_bytes = entry.zombies * record->block_size;
+
+            // a type may have a record for each kind of state
+            auto it = std::find_if(
+                ret.types.begin(), ret.types.end(), [&](auto& other) {
+                    return std::strcmp(other.name, entry.name) == 0;
+                });
+            if (it == ret.types.end())
+                ret.types.push_back(entry);
+            else
+                detail::_proxy_stats_merge(*it, entry);
+            detail::_proxy_stats_merge(ret.total, entry);
+        }
+        return ret;
+    }
+
+    // the references a proxy_biased state got from its owner thread and
+    // released by other threads are only settled by the owner: call it
+    // from time to time (e.g. once per tick) on the threads creating the
+    // proxy_biased states, returns the number of merged states
+    inline size_t proxy_biased_flush() {
+        auto owner = detail::_proxy_biased_owner::current();
+        return owner ? owner->flush() : 0;
+    }
+
+    // runs the deleters the calling thread queued for the
+    // proxy_deferred_delete types, call it at a safe point (e.g. at the end
+    // of the tick). Returns the number of deleters run.
+    inline size_t proxy_drain_deletes() {
+        auto queue = detail::_proxy_reclaim_queue::local();
+        return queue ? queue->drain() : 0;
+    }
+
+    // stops once the budget is spent, at least one deleter runs
+    template <class Rep, class Period>
+    size_t proxy_drain_deletes(std::chrono::duration<Rep, Period> budget) {
+        using clock_type = detail::_proxy_reclaim_queue::clock_type;
+        auto queue = detail::_proxy_reclaim_queue::local();
+        const auto duration =
+            std::chrono::duration_cast<clock_type::duration>(budget);
+        return queue ? queue->drain(clock_type::now() + duration) : 0;
+    }
+
+    inline size_t proxy_pending_deletes() {
+        auto queue = detail::_proxy_reclaim_queue::local();
+        return queue ? queue->size() : 0;
+    }
+
+    // while a guard is open on a thread, the proxy_non_atomic objects that
+    // thread deletes (proxy_delete(), the last owning proxy detaching) are
+    // expired right away but destroyed only when the outermost guard
+    // closes, so an object seen alive() once can be used through
+    // get_unchecked() until then. The objects of proxy_parent_base and
+    // proxy_intrusive_base aren't deleted by their proxies and aren't
+    // covered.
+    class proxy_deletion_guard {
+       public:
+        proxy_deletion_guard() { detail::_proxy_deletion_scope::enter(); }
+        proxy_deletion_guard(const proxy_deletion_guard&) = delete;
+        proxy_deletion_guard& operator=(const proxy_deletion_guard&) = delete;
+        ~proxy_deletion_guard() { detail::_proxy_deletion_scope::leave(); }
+
+        // deleters waiting for the outermost guard of the calling thread
+        static size_t pending() {
+            return detail::_proxy_deletion_scope::size();
         }
     };
 
-    template <class T, class U>
-    proxy::proxy_ptr<T> static_pointer_cast(
-        const proxy::proxy_ptr<U>& r) noexcept {
-        auto p = static_cast<typename proxy::proxy_ptr<T>::Type*>(r.get());
-        return proxy::proxy_ptr<T>{p, r};
+    using deletion_guard = proxy_deletion_guard;
+
+    // the casts keep the adjusted pointer, and an expired r gives an expired
+    // proxy sharing its state and keeping its hashkey. The casts that need
+    // the object don't: dynamic_pointer_cast gives an empty proxy, and the
+    // casts through a virtual base give a proxy to nullptr.
+    template <class T, class U, class A>
+    proxy_ptr<T, A> static_pointer_cast(const proxy_ptr<U, A>& r) noexcept {
+        using Type = typename proxy_ptr<T, A>::Type;
+        using From = typename proxy_ptr<U, A>::Type;
+        if constexpr (!detail::is_proxy_offset_static<From, Type>)
+            return proxy_ptr<T, A>{static_cast<Type*>(r.get()), r};
+        else if constexpr (detail::is_proxy_downcast<From, Type>)
+            return proxy_ptr<T, A>{
+                detail::_proxy_static_downcast<Type>(r.hashkey()), r};
+        else
+            return proxy_ptr<T, A>{static_cast<Type*>(r.hashkey()), r};
     }
 
-    template <class T, class U>
-    proxy::proxy_ptr<T> dynamic_pointer_cast(
-        const proxy::proxy_ptr<U>& r) noexcept {
-        if (auto p = dynamic_cast<typename proxy::proxy_ptr<T>::Type*>(r.get()))
-            return proxy::proxy_ptr<T>{p, r};
+    template <class T, class U, class A>
+    proxy_ptr<T, A> dynamic_pointer_cast(const proxy_ptr<U, A>& r) noexcept {
+        if (auto p = dynamic_cast<typename proxy_ptr<T, A>::Type*>(r.get()))
+            return proxy_ptr<T, A>{p, r};
         else
-            return proxy::proxy_ptr<T>{};
+            return proxy_ptr<T, A>{};
     }
 
-    template <class T, class U>
-    proxy::proxy_ptr<T> const_pointer_cast(
-        const proxy::proxy_ptr<U>& r) noexcept {
-        auto p = const_cast<typename proxy::proxy_ptr<T>::Type*>(r.get());
-        return proxy::proxy_ptr<T>{p, r};
+    template <class T, class U, class A>
+    proxy_ptr<T, A> const_pointer_cast(const proxy_ptr<U, A>& r) noexcept {
+        auto p = const_cast<typename proxy_ptr<T, A>::Type*>(r.hashkey());
+        return proxy_ptr<T, A>{p, r};
     }
 
-    template <class T, class U>
-    proxy::proxy_ptr<T> reinterpret_pointer_cast(
-        const proxy::proxy_ptr<U>& r) noexcept {
-        auto p = reinterpret_cast<typename proxy::proxy_ptr<T>::Type*>(r.get());
-        return proxy::proxy_ptr<T>{p, r};
+    template <class T, class U, class A>
+    proxy_ptr<T, A> reinterpret_pointer_cast(
+        const proxy_ptr<U, A>& r) noexcept {
+        auto p =
+            reinterpret_cast<typename proxy_ptr<T, A>::Type*>(r.hashkey());
+        return proxy_ptr<T, A>{p, r};
     }
 
 }  // namespace proxy
@@ -673,10 +2885,78 @@ PROXY_PTR_NO_DISCARD bool operator<=(
     return !(_Right < _Left);
 }
 
+namespace proxy {
+    namespace detail {
+        // the keys keep their pointer type, so a base and a derived pointer
+        // are adjusted to the common type like for operator==
+        template <class Ty, class AtomicType>
+        const auto* _proxy_key(const proxy_ptr<Ty, AtomicType>& ptr) {
+            return ptr.hashkey();
+        }
+        template <class Ty, class AtomicType>
+        const auto* _proxy_key(const proxy_ref<Ty, AtomicType>& ptr) {
+            return ptr.hashkey();
+        }
+        template <class Ty> const Ty* _proxy_key(const Ty* ptr) {
+            return ptr;
+        }
+
+        template <class Left, class Right>
+        using _proxy_common_key = std::common_type_t<
+            decltype(_proxy_key(std::declval<const Left&>())),
+            decltype(_proxy_key(std::declval<const Right&>()))>;
+    }  // namespace detail
+
+    // transparent functors: proxy_ptr, proxy_ref and raw pointers can be
+    // mixed, e.g. std::unordered_set<proxy_ptr<T>, proxy_hash, proxy_equal>
+    // can be searched by T* without making a proxy. the hash sees one key
+    // at a time, so the keys to a Derived looked up in a set of Base at a
+    // non-zero offset need basic_proxy_hash<Base> to hash the Base address
+    template <class Type = void> struct basic_proxy_hash {
+        using is_transparent = void;
+
+        template <class Key> size_t operator()(const Key& key) const {
+            const Type* ptr = detail::_proxy_key(key);
+            return detail::_proxy_hash_mix(ptr);
+        }
+    };
+
+    using proxy_hash = basic_proxy_hash<>;
+
+    struct proxy_equal {
+        using is_transparent = void;
+
+        template <class Left, class Right>
+        bool operator()(const Left& lhs, const Right& rhs) const {
+            detail::_proxy_common_key<Left, Right> left =
+                detail::_proxy_key(lhs);
+            return left == detail::_proxy_key(rhs);
+        }
+    };
+
+    struct proxy_less {
+        using is_transparent = void;
+
+        template <class Left, class Right>
+        bool operator()(const Left& lhs, const Right& rhs) const {
+            using Key = detail::_proxy_common_key<Left, Right>;
+            return std::less<Key>()(detail::_proxy_key(lhs),
+                                    detail::_proxy_key(rhs));
+        }
+    };
+}  // namespace proxy
+
 template <class Type, class AtomicType>
 struct std::hash<proxy::proxy_ptr<Type, AtomicType>> {
-    size_t operator()(const proxy::proxy_ptr<Type, AtomicType> _ptr) const {
-        return reinterpret_cast<std::uintptr_t>(_ptr.hashkey());
+    size_t operator()(const proxy::proxy_ptr<Type, AtomicType>& _ptr) const {
+        return proxy::proxy_hash()(_ptr);
+    }
+};
+
+template <class Type, class AtomicType>
+struct std::hash<proxy::proxy_ref<Type, AtomicType>> {
+    size_t operator()(const proxy::proxy_ref<Type, AtomicType>& _ptr) const {
+        return proxy::proxy_hash()(_ptr);
     }
 };
 
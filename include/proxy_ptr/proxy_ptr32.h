@@ -0,0 +1,401 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2022 IkarusDeveloper. All rights reserved.
+//
+// This code is licensed under the MIT License (MIT).
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef __PROXY_PROXY_PTR32_H__
+    #define __PROXY_PROXY_PTR32_H__
+
+    #include "proxy_ptr.h"
+    #include <cstdint>
+    #include <functional>
+    #include <mutex>
+    #include <new>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #endif
+
+namespace proxy {
+    template <class _RTy, class AtomicTypeFlag = proxy_non_atomic>
+    class proxy_ptr32;
+
+    namespace detail {
+        // index of the highest set bit, v can't be 0
+        inline unsigned _proxy_log2(std::uint64_t v) noexcept {
+    #if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanReverse64(&index, v);
+            return static_cast<unsigned>(index);
+    #else
+            return 63u - static_cast<unsigned>(__builtin_clzll(v));
+    #endif
+        }
+
+        // owning state living in a slot of the arena
+        template <class AtomicType>
+        class _proxy_arena_state_base
+            : public _proxy_owning_state_base<AtomicType> {
+           public:
+            using owning_type = _proxy_owning_state_base<AtomicType>;
+            using base_type = _proxy_common_state_base<AtomicType>;
+
+            _proxy_arena_state_base(void* p, typename base_type::destroy_fn fn,
+                                    typename base_type::bits_t flags,
+                                    std::uint32_t index)
+                : owning_type(p, fn, flags), _index(index) {}
+
+            std::uint32_t _index;
+        };
+
+        // slots of the proxy_ptr32 states: the chunks double in size so
+        // they never move, and resolving an index is a bit scan and a load.
+        // Index 0 is never handed out, the chunks are never given back.
+        template <class AtomicType> class _proxy_arena {
+           public:
+            using state_type = _proxy_arena_state_base<AtomicType>;
+
+            static constexpr unsigned first_bits = 10;
+            static constexpr unsigned chunk_count = 33 - first_bits;
+
+            // constant-initialized, the hot path doesn't check a guard
+            static _proxy_arena& instance() noexcept { return _instance; }
+
+            state_type* at(std::uint32_t index) const noexcept {
+                const auto biased = _biased(index);
+                const auto chunk = _chunk_of(biased);
+                auto slots = _chunks[chunk].load(std::memory_order_acquire);
+                return reinterpret_cast<state_type*>(
+                    slots + (biased - _chunk_first(chunk)));
+            }
+
+            std::uint32_t allocate() {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_free) {
+                    const auto index = _free;
+                    _free = *std::launder(
+                        reinterpret_cast<std::uint32_t*>(at(index)));
+                    return index;
+                }
+
+                if (!_next)
+                    throw std::bad_alloc();
+                const auto chunk = _chunk_of(_biased(_next));
+                if (!_chunks[chunk].load(std::memory_order_relaxed)) {
+                    const auto size = _chunk_first(chunk) * sizeof(_slot);
+                    auto slots = static_cast<_slot*>(::operator new(size));
+                    _chunks[chunk].store(slots, std::memory_order_release);
+                }
+                return _next++;
+            }
+
+            // the state must be destroyed already
+            void deallocate(std::uint32_t index) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                ::new (static_cast<void*>(at(index))) std::uint32_t(_free);
+                _free = index;
+            }
+
+           private:
+            struct _slot {
+                alignas(state_type) unsigned char bytes[sizeof(state_type)];
+            };
+
+            constexpr _proxy_arena() noexcept = default;
+
+            // chunk k holds the biased indices [2^(k + first_bits),
+            // 2^(k + first_bits + 1))
+            static std::uint64_t _biased(std::uint32_t index) noexcept {
+                return std::uint64_t(index) + (std::uint64_t(1) << first_bits);
+            }
+            static unsigned _chunk_of(std::uint64_t biased) noexcept {
+                return _proxy_log2(biased) - first_bits;
+            }
+            static std::uint64_t _chunk_first(unsigned chunk) noexcept {
+                return std::uint64_t(1) << (chunk + first_bits);
+            }
+
+            static _proxy_arena _instance;
+
+            std::atomic<_slot*> _chunks[chunk_count]{};
+            std::mutex _mutex;
+            std::uint32_t _free = 0;
+            std::uint32_t _next = 1;
+        };
+
+        template <class AtomicType>
+        _proxy_arena<AtomicType> _proxy_arena<AtomicType>::_instance;
+
+        template <class Type, class AtomicType>
+        class _proxy_arena_state : public _proxy_arena_state_base<AtomicType> {
+           public:
+            using arena_base = _proxy_arena_state_base<AtomicType>;
+            using base_type = _proxy_common_state_base<AtomicType>;
+
+            _proxy_arena_state(Type* ptr, std::uint32_t index)
+                : arena_base(ptr, &_destroy,
+                             deferred_delete_flags<Type, AtomicType>, index) {
+                this->template _stats_init<Type, _proxy_arena_state>(true);
+            }
+
+           private:
+            static void _destroy(base_type* base,
+                                 typename base_type::destroy_op op) {
+                auto state = static_cast<_proxy_arena_state*>(base);
+                if (op == base_type::destroy_op::object) {
+                    delete static_cast<Type*>(state->_ptr);
+                    return;
+                }
+                if (op == base_type::destroy_op::release)
+                    return;
+                const auto index = state->_index;
+                state->~_proxy_arena_state();
+                _proxy_arena<AtomicType>::instance().deallocate(index);
+            }
+        };
+
+        static_assert(sizeof(_proxy_arena_state<int, proxy_non_atomic>) ==
+                      sizeof(_proxy_arena_state_base<proxy_non_atomic>));
+
+        // the block only knows the pointer it was created with and there's
+        // no room for an adjusted one, so only the conversions that can't
+        // move the pointer are allowed. A base can be at a non zero offset:
+        // the conversions to a base and the static and dynamic casts go
+        // through proxy(), e.g. proxy_ptr<Base> base = ptr32.proxy();
+        template <class From, class To>
+        constexpr bool is_proxy32_castable =
+            std::is_same_v<std::remove_cv_t<extract_proxy_type<From>>,
+                           std::remove_cv_t<extract_proxy_type<To>>>;
+
+        template <class From, class To>
+        constexpr bool is_proxy32_convertible =
+            is_proxy32_castable<From, To> && is_proxy_convertible<From, To>;
+    }  // namespace detail
+
+    // proxy_ptr stored as a 32-bit index into an arena of control blocks,
+    // for the structures holding lots of proxies. The object is allocated
+    // on its own, and proxy() gives a proxy_ptr sharing the same block.
+    template <class _RTy, class AtomicTypeFlag> class proxy_ptr32 {
+        static_assert(!PROXY_PTR_IS_ARRAY(_RTy),
+                      "proxy_ptr32 doesn't support arrays");
+        static_assert(!std::is_same_v<AtomicTypeFlag, proxy_biased>,
+                      "proxy_ptr32 doesn't support proxy_biased");
+
+       public:
+        using Type = detail::extract_proxy_type<_RTy>;
+        using _common_PtrType =
+            detail::_proxy_common_state_base<AtomicTypeFlag>;
+        using arena_type = detail::_proxy_arena<AtomicTypeFlag>;
+
+        constexpr proxy_ptr32() noexcept = default;
+        constexpr proxy_ptr32(std::nullptr_t) noexcept {}
+        explicit proxy_ptr32(Type* ptr) {
+            using state_type = detail::_proxy_arena_state<Type, AtomicTypeFlag>;
+            auto& arena = arena_type::instance();
+            std::uint32_t index;
+            try {
+                index = arena.allocate();
+            } catch (...) {
+                delete ptr;
+                throw;
+            }
+            ::new (static_cast<void*>(arena.at(index)))
+                state_type(ptr, index);
+            _attach(index);
+        }
+        proxy_ptr32(const proxy_ptr32& r) { _attach(r._index); }
+        proxy_ptr32(proxy_ptr32&& r) noexcept
+            : _index(std::exchange(r._index, 0)) {}
+        template <class Type2,
+                  std::enable_if_t<detail::is_proxy32_convertible<Type2, Type>,
+                                   int> = 0>
+        proxy_ptr32(const proxy_ptr32<Type2, AtomicTypeFlag>& r) {
+            _attach(r._index);
+        }
+        template <class Type2,
+                  std::enable_if_t<detail::is_proxy32_convertible<Type2, Type>,
+                                   int> = 0>
+        proxy_ptr32(proxy_ptr32<Type2, AtomicTypeFlag>&& r) noexcept
+            : _index(std::exchange(r._index, 0)) {}
+        // used by const_pointer_cast, the pointer doesn't move
+        template <class Type2,
+                  std::enable_if_t<detail::is_proxy32_castable<Type, Type2>,
+                                   int> = 0>
+        explicit proxy_ptr32(Type* ptr,
+                             const proxy_ptr32<Type2, AtomicTypeFlag>& other) {
+            PROXY_PTR_UNUSED(ptr);
+            _attach(other._index);
+        }
+
+        ~proxy_ptr32() { _detach(); }
+
+        proxy_ptr32& operator=(const proxy_ptr32& r) {
+            if (r._index != _index) {
+                _detach();
+                _attach(r._index);
+            }
+            return *this;
+        }
+        proxy_ptr32& operator=(proxy_ptr32&& r) noexcept {
+            proxy_ptr32(std::move(r)).swap(*this);
+            return *this;
+        }
+        proxy_ptr32& operator=(std::nullptr_t) {
+            _detach();
+            return *this;
+        }
+
+        explicit operator bool() const { return alive(); }
+
+        std::uint32_t index() const noexcept { return _index; }
+
+        _common_PtrType* _state() const noexcept {
+            return _index ? arena_type::instance().at(_index) : nullptr;
+        }
+
+        Type* hashkey() const {
+            auto state = _state();
+            return state ? static_cast<Type*>(state->get()) : nullptr;
+        }
+
+        Type* get() const {
+            auto state = _state();
+            if (!state || !state->alive())
+                return nullptr;
+            return static_cast<Type*>(state->get());
+        }
+
+        bool alive() const {
+            auto state = _state();
+            return state && state->alive() && state->get();
+        }
+        bool expired() const { return !alive(); }
+
+        Type* operator->() const {
+            assert(alive());
+            return get();
+        }
+        Type& operator*() const {
+            assert(alive());
+            return *get();
+        }
+
+        Type* proxy_release() {
+            auto state = _state();
+            return state ? static_cast<Type*>(state->release()) : nullptr;
+        }
+        void proxy_delete() {
+            if (auto state = _state())
+                state->delete_ptr();
+        }
+
+        // an empty guard if the object is already expired
+        PROXY_PTR_NO_DISCARD proxy_pin<_RTy, AtomicTypeFlag> pin() const {
+            using pin_type = proxy_pin<_RTy, AtomicTypeFlag>;
+            auto state = _state();
+            if (state && state->pin())
+                return detail::_proxy_access::make_pin<pin_type>(state,
+                                                                 hashkey());
+            return {};
+        }
+        PROXY_PTR_NO_DISCARD proxy_pin<_RTy, AtomicTypeFlag> lock() const {
+            return pin();
+        }
+
+        // a full size proxy_ptr sharing the block
+        proxy_ptr<_RTy, AtomicTypeFlag> proxy() const {
+            return detail::_proxy_access::make<
+                proxy_ptr<_RTy, AtomicTypeFlag>>(_state());
+        }
+
+        // a block has a single index, so the casts compare equal as well
+        template <class Type2>
+        PROXY_PTR_NO_DISCARD bool operator==(
+            const proxy_ptr32<Type2, AtomicTypeFlag>& r) const noexcept {
+            return _index == r._index;
+        }
+        template <class Type2>
+        PROXY_PTR_NO_DISCARD bool operator!=(
+            const proxy_ptr32<Type2, AtomicTypeFlag>& r) const noexcept {
+            return _index != r._index;
+        }
+        template <class Type2>
+        PROXY_PTR_NO_DISCARD bool operator<(
+            const proxy_ptr32<Type2, AtomicTypeFlag>& r) const noexcept {
+            return _index < r._index;
+        }
+        PROXY_PTR_NO_DISCARD bool operator==(std::nullptr_t) const noexcept {
+            return !alive();
+        }
+        PROXY_PTR_NO_DISCARD bool operator!=(std::nullptr_t) const noexcept {
+            return alive();
+        }
+
+        void swap(proxy_ptr32& r) noexcept { std::swap(_index, r._index); }
+
+       private:
+        template <class, class> friend class proxy_ptr32;
+
+        void _attach(std::uint32_t index) {
+            _index = index;
+            if (_index)
+                arena_type::instance().at(_index)->inc_ref();
+        }
+        void _detach() {
+            if (!_index)
+                return;
+            auto state = arena_type::instance().at(std::exchange(_index, 0));
+            if (!state->dec_ref())
+                state->destroy();
+        }
+
+        std::uint32_t _index = 0;
+    };
+
+    static_assert(sizeof(proxy_ptr32<int>) == sizeof(std::uint32_t));
+
+    template <class Type, class AtomicType>
+    void swap(proxy_ptr32<Type, AtomicType>& _Left,
+              proxy_ptr32<Type, AtomicType>& _Right) noexcept {
+        _Left.swap(_Right);
+    }
+
+    template <class Ty, class... Args>
+    std::enable_if_t<!PROXY_PTR_IS_ARRAY(Ty), proxy_ptr32<Ty>> make_proxy32(
+        Args&&... Arguments) {
+        return proxy_ptr32<Ty>(new Ty(std::forward<Args>(Arguments)...));
+    }
+
+    template <class Ty, class... Args>
+    std::enable_if_t<!PROXY_PTR_IS_ARRAY(Ty), proxy_ptr32<Ty, proxy_atomic>>
+    make_proxy32_atomic(Args&&... Arguments) {
+        return proxy_ptr32<Ty, proxy_atomic>(
+            new Ty(std::forward<Args>(Arguments)...));
+    }
+
+    template <class T, class U, class A>
+    proxy_ptr32<T, A> const_pointer_cast(const proxy_ptr32<U, A>& r) noexcept {
+        auto p = const_cast<typename proxy_ptr32<T, A>::Type*>(r.get());
+        return proxy_ptr32<T, A>{p, r};
+    }
+}  // namespace proxy
+
+template <class Type, class AtomicType>
+struct std::hash<proxy::proxy_ptr32<Type, AtomicType>> {
+    size_t operator()(
+        const proxy::proxy_ptr32<Type, AtomicType>& _Proxy) const noexcept {
+        return std::hash<std::uint32_t>()(_Proxy.index());
+    }
+};
+
+#endif
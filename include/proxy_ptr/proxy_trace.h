@@ -0,0 +1,190 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2022 IkarusDeveloper. All rights reserved.
+//
+// This code is licensed under the MIT License (MIT).
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef __PROXY_PROXY_TRACE_H__
+    #define __PROXY_PROXY_TRACE_H__
+
+    #include "proxy_ptr.h"
+    #include <algorithm>
+    #include <cstdint>
+    #include <cstdio>
+    #include <cstring>
+    #include <vector>
+
+namespace proxy {
+    constexpr bool proxy_trace_enabled = PROXY_PTR_TRACE != 0;
+
+    using proxy_trace_op = detail::_proxy_trace_op;
+
+    enum class proxy_trace_format { csv, binary };
+
+    struct proxy_trace_event {
+        std::uint64_t time_ns;  // steady_clock
+        const void* block;
+        std::uint32_t type_id;  // 0 when the type is unknown
+        std::uint32_t thread;   // index of the ring, reused by new threads
+        proxy_trace_op op;
+    };
+
+    inline const char* proxy_trace_op_name(proxy_trace_op op) {
+        switch (op) {
+            case proxy_trace_op::create:
+                return "create";
+            case proxy_trace_op::copy:
+                return "copy";
+            case proxy_trace_op::detach:
+                return "detach";
+            case proxy_trace_op::proxy_delete:
+                return "proxy_delete";
+            case proxy_trace_op::proxy_release:
+                return "proxy_release";
+            case proxy_trace_op::last_detach:
+                return "last_detach";
+        }
+        return "unknown";
+    }
+
+    // typeid().name() of the type the blocks were created for
+    inline const char* proxy_trace_type_name(std::uint32_t type_id) {
+        auto record = detail::_proxy_stats_record::head().load();
+        for (; record; record = record->next)
+            if (record->id == type_id)
+                return record->name;
+        return "";
+    }
+
+    // the events still in the rings of every thread, sorted by time. The
+    // threads keep recording meanwhile, the events they overwrite while
+    // the rings are copied are dropped.
+    inline std::vector<proxy_trace_event> proxy_trace_snapshot() {
+        using ring_type = detail::_proxy_trace_ring;
+        std::vector<proxy_trace_event> ret;
+        std::vector<ring_type::event> events;
+        for (auto ring = ring_type::first(); ring; ring = ring->next()) {
+            events.clear();
+            ring->copy(events);
+            for (auto& event : events)
+                ret.push_back({event.time_ns, event.block, event.type,
+                               ring->thread(), event.op});
+        }
+        std::stable_sort(ret.begin(), ret.end(),
+                         [](const auto& left, const auto& right) {
+                             return left.time_ns < right.time_ns;
+                         });
+        return ret;
+    }
+
+    // the snapshots won't see the events recorded so far
+    inline void proxy_trace_clear() {
+        using ring_type = detail::_proxy_trace_ring;
+        for (auto ring = ring_type::first(); ring; ring = ring->next())
+            ring->clear();
+    }
+
+    namespace detail {
+        // binary dump, in the byte order of the machine:
+        //   "PXTR", u32 version, u32 type count,
+        //   per type: u32 id, u32 name length, name,
+        //   u64 event count, per event the _proxy_trace_record below
+        struct _proxy_trace_record {
+            std::uint64_t time_ns;
+            std::uint64_t block;
+            std::uint32_t type_id;
+            std::uint16_t thread;
+            std::uint8_t op;
+            std::uint8_t reserved;
+        };
+        static_assert(sizeof(_proxy_trace_record) == 24);
+
+        inline bool _proxy_trace_write_binary(
+            std::FILE* file, const std::vector<proxy_trace_event>& events) {
+            auto write = [file](const void* data, size_t size) {
+                return std::fwrite(data, 1, size, file) == size;
+            };
+            const std::uint32_t version = 1;
+            std::uint32_t type_count = 0;
+            auto record = _proxy_stats_record::head().load();
+            for (auto it = record; it; it = it->next)
+                type_count++;
+
+            bool ok = write("PXTR", 4) && write(&version, 4) &&
+                      write(&type_count, 4);
+            for (auto it = record; ok && it; it = it->next) {
+                const auto length =
+                    static_cast<std::uint32_t>(std::strlen(it->name));
+                ok = write(&it->id, 4) && write(&length, 4) &&
+                     write(it->name, length);
+            }
+
+            const std::uint64_t event_count = events.size();
+            ok = ok && write(&event_count, 8);
+            for (size_t i = 0; ok && i < events.size(); i++) {
+                auto& event = events[i];
+                const _proxy_trace_record out{
+                    event.time_ns,
+                    reinterpret_cast<std::uintptr_t>(event.block),
+                    event.type_id, static_cast<std::uint16_t>(event.thread),
+                    static_cast<std::uint8_t>(event.op), 0};
+                ok = write(&out, sizeof(out));
+            }
+            return ok;
+        }
+
+        // time_ns,thread,op,block,type
+        inline bool _proxy_trace_write_csv(
+            std::FILE* file, const std::vector<proxy_trace_event>& events) {
+            // the ids count up from 1 as the records are pushed on the head,
+            // so the names are indexed by id once instead of per event. The
+            // records of the events were pushed before the snapshot.
+            std::vector<const char*> names;
+            auto record = _proxy_stats_record::head().load();
+            names.assign(record ? record->id + 1 : 1, "");
+            for (; record; record = record->next)
+                names[record->id] = record->name;
+
+            bool ok = std::fputs("time_ns,thread,op,block,type\n", file) >= 0;
+            for (size_t i = 0; ok && i < events.size(); i++) {
+                auto& event = events[i];
+                const char* name =
+                    event.type_id < names.size() ? names[event.type_id] : "";
+                ok = std::fprintf(
+                         file, "%llu,%u,%s,%p,\"%s\"\n",
+                         static_cast<unsigned long long>(event.time_ns),
+                         static_cast<unsigned>(event.thread),
+                         proxy_trace_op_name(event.op), event.block,
+                         name) >= 0;
+            }
+            return ok;
+        }
+    }  // namespace detail
+
+    // writes proxy_trace_snapshot() to path, false if it can't be written
+    inline bool proxy_trace_dump(
+        const char* path, proxy_trace_format format = proxy_trace_format::csv) {
+        const auto events = proxy_trace_snapshot();
+        const bool binary = format == proxy_trace_format::binary;
+        auto file = std::fopen(path, binary ? "wb" : "w");
+        if (!file)
+            return false;
+
+        const bool ok = binary
+                            ? detail::_proxy_trace_write_binary(file, events)
+                            : detail::_proxy_trace_write_csv(file, events);
+        return std::fclose(file) == 0 && ok;
+    }
+}  // namespace proxy
+
+#endif
@@ -0,0 +1,285 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2022 IkarusDeveloper. All rights reserved.
+//
+// This code is licensed under the MIT License (MIT).
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef __PROXY_PROXY_VECTOR_H__
+    #define __PROXY_PROXY_VECTOR_H__
+
+    #include "proxy_ptr.h"
+    #include <algorithm>
+    #include <cstdint>
+    #include <iterator>
+    #include <vector>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #endif
+
+namespace proxy {
+    namespace detail {
+        // index of the lowest set bit, v can't be 0
+        inline unsigned _proxy_ctz(std::uint64_t v) noexcept {
+    #if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward64(&index, v);
+            return static_cast<unsigned>(index);
+    #else
+            return static_cast<unsigned>(__builtin_ctzll(v));
+    #endif
+        }
+
+        inline unsigned _proxy_popcount(std::uint64_t v) noexcept {
+    #if defined(_MSC_VER)
+            return static_cast<unsigned>(__popcnt64(v));
+    #else
+            return static_cast<unsigned>(__builtin_popcountll(v));
+    #endif
+        }
+    }  // namespace detail
+
+    // vector of proxies with a bitset mirroring their alive flags: the
+    // iterators skip the slots found expired, and erase_expired() compacts
+    // the vector scanning the bitset a word (64 slots) at a time without
+    // reading the control blocks. The mirror is refreshed by refresh() and
+    // for_each_alive(), until then the slots expired in the meantime are
+    // still visited and kept. The order is kept.
+    template <class Ty, class AtomicType = proxy_non_atomic>
+    class proxy_vector {
+       public:
+        using value_type = proxy_ptr<Ty, AtomicType>;
+        using size_type = size_t;
+
+        // visits the slots alive at the last refresh
+        class const_iterator {
+           public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = proxy_vector::value_type;
+            using difference_type = std::ptrdiff_t;
+            using reference = const value_type&;
+            using pointer = const value_type*;
+
+            const_iterator() = default;
+
+            reference operator*() const { return _owner->_items[_index]; }
+            pointer operator->() const { return &_owner->_items[_index]; }
+            const_iterator& operator++() {
+                _index = _owner->_next_alive(_index + 1);
+                return *this;
+            }
+            const_iterator operator++(int) {
+                auto it = *this;
+                ++*this;
+                return it;
+            }
+            bool operator==(const const_iterator& r) const {
+                return _index == r._index;
+            }
+            bool operator!=(const const_iterator& r) const {
+                return _index != r._index;
+            }
+
+            // the slot, for operator[] and erase_unordered()
+            size_t index() const { return _index; }
+
+           private:
+            friend class proxy_vector;
+            const_iterator(const proxy_vector* owner, size_t index)
+                : _owner(owner), _index(index) {}
+
+            const proxy_vector* _owner = nullptr;
+            size_t _index = 0;
+        };
+        using iterator = const_iterator;
+
+        proxy_vector() = default;
+
+        // the slots are read only, so the mirror can't go out of sync with
+        // them
+        const value_type& operator[](size_t index) const {
+            return _items[index];
+        }
+        const value_type& back() const { return _items.back(); }
+
+        void push_back(const value_type& value) {
+            const bool alive = value.alive();
+            _grow_words();
+            _items.push_back(value);
+            _set_bit(_items.size() - 1, alive);
+        }
+        void push_back(value_type&& value) {
+            const bool alive = value.alive();
+            _grow_words();
+            _items.push_back(std::move(value));
+            _set_bit(_items.size() - 1, alive);
+        }
+        void pop_back() {
+            _set_bit(_items.size() - 1, false);
+            _items.pop_back();
+            _words.resize(_word_count(_items.size()));
+        }
+
+        // moves the last slot into index, the order isn't kept
+        void erase_unordered(size_t index) {
+            const size_t last = _items.size() - 1;
+            if (index != last) {
+                _items[index] = std::move(_items[last]);
+                _set_bit(index, _test_bit(last));
+            }
+            pop_back();
+        }
+
+        // reads the alive flags of the slots that were alive, the expired
+        // ones never come back. Returns the number of alive slots.
+        size_t refresh() {
+            size_t live = 0;
+            for (size_t w = 0; w < _words.size(); w++) {
+                _words[w] = _refresh_word(w);
+                live += detail::_proxy_popcount(_words[w]);
+            }
+            return live;
+        }
+
+        // calls fn(object) for the alive slots, and clears the bits of the
+        // expired ones as it finds them, so a tick walking the vector also
+        // refreshes it. fn must not add or remove slots. Returns the number
+        // of alive slots.
+        template <class Func> size_t for_each_alive(Func&& fn) {
+            size_t live = 0;
+            for (size_t w = 0; w < _words.size(); w++) {
+                auto bits = _words[w];
+                for (auto scan = bits; scan; scan &= scan - 1) {
+                    const auto bit = detail::_proxy_ctz(scan);
+                    if (auto ptr = _items[w * 64 + bit].get())
+                        fn(*ptr);
+                    else
+                        bits &= ~(std::uint64_t(1) << bit);
+                }
+                _words[w] = bits;
+                live += detail::_proxy_popcount(bits);
+            }
+            return live;
+        }
+
+        // drops the slots found expired by the last refresh() or
+        // for_each_alive(), keeping the order of the others: it scans the
+        // bitset a word at a time and doesn't read the control blocks of
+        // the slots it keeps, a full word at its place moves nothing.
+        // Returns the number of dropped slots.
+        size_t erase_expired() {
+            size_t out = 0;
+            for (size_t w = 0; w < _words.size(); w++) {
+                auto bits = _words[w];
+                if (bits == ~std::uint64_t(0) && out == w * 64) {
+                    out += 64;
+                    continue;
+                }
+                for (; bits; bits &= bits - 1) {
+                    const size_t index = w * 64 + detail::_proxy_ctz(bits);
+                    if (index != out)
+                        _items[out] = std::move(_items[index]);
+                    out++;
+                }
+            }
+
+            const size_t dropped = _items.size() - out;
+            _items.erase(_items.begin() + out, _items.end());
+            _words.assign(_word_count(out), ~std::uint64_t(0));
+            if (out % 64)
+                _words.back() = (std::uint64_t(1) << (out % 64)) - 1;
+            return dropped;
+        }
+
+        // the slots alive at the last refresh
+        size_t alive_count() const {
+            size_t live = 0;
+            for (auto bits : _words)
+                live += detail::_proxy_popcount(bits);
+            return live;
+        }
+
+        const_iterator begin() const { return {this, _next_alive(0)}; }
+        const_iterator end() const { return {this, _items.size()}; }
+
+        // counts the expired slots not dropped yet
+        size_t size() const noexcept { return _items.size(); }
+        bool empty() const noexcept { return _items.empty(); }
+        size_t capacity() const noexcept { return _items.capacity(); }
+        void reserve(size_t count) {
+            _items.reserve(count);
+            _words.reserve(_word_count(count));
+        }
+        void clear() noexcept {
+            _items.clear();
+            _words.clear();
+        }
+
+       private:
+        static size_t _word_count(size_t count) { return (count + 63) / 64; }
+
+        bool _test_bit(size_t index) const {
+            return (_words[index / 64] >> (index % 64)) & 1;
+        }
+        void _set_bit(size_t index, bool value) {
+            const auto mask = std::uint64_t(1) << (index % 64);
+            if (value)
+                _words[index / 64] |= mask;
+            else
+                _words[index / 64] &= ~mask;
+        }
+        // before a push, so a throwing one leaves a zero word at most
+        void _grow_words() {
+            _words.resize(_word_count(_items.size() + 1));
+        }
+
+        // the flags are gathered without branching so the reads of the
+        // blocks overlap. A mostly set word is read whole, the addresses
+        // don't wait for the bit scan; a sparse one skips its expired slots.
+        std::uint64_t _refresh_word(size_t w) const {
+            const auto word = _words[w];
+            const auto items = _items.data() + w * 64;
+            std::uint64_t bits = 0;
+            if (detail::_proxy_popcount(word) > 32) {
+                const size_t count =
+                    std::min<size_t>(64, _items.size() - w * 64);
+                for (size_t i = 0; i < count; i++)
+                    bits |= std::uint64_t(items[i].alive()) << i;
+                return bits & word;
+            }
+            for (auto scan = word; scan; scan &= scan - 1) {
+                const auto bit = detail::_proxy_ctz(scan);
+                bits |= std::uint64_t(items[bit].alive()) << bit;
+            }
+            return bits;
+        }
+
+        // the first slot alive at the last refresh from index on
+        size_t _next_alive(size_t index) const {
+            size_t w = index / 64;
+            if (w >= _words.size())
+                return _items.size();
+            auto bits = _words[w] & (~std::uint64_t(0) << (index % 64));
+            while (!bits) {
+                if (++w == _words.size())
+                    return _items.size();
+                bits = _words[w];
+            }
+            return w * 64 + detail::_proxy_ctz(bits);
+        }
+
+        std::vector<value_type> _items;
+        std::vector<std::uint64_t> _words;
+    };
+}  // namespace proxy
+
+#endif
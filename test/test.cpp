@@ -1,10 +1,22 @@
 #include "../include/proxy_ptr/proxy_ptr.h"
+#include "../include/proxy_ptr/proxy_ptr32.h"
+#include "../include/proxy_ptr/proxy_handle.h"
+#include "../include/proxy_ptr/proxy_epoch.h"
+#include "../include/proxy_ptr/proxy_domain.h"
+#include "../include/proxy_ptr/proxy_flat.h"
+#include "../include/proxy_ptr/proxy_trace.h"
+#include "../include/proxy_ptr/proxy_vector.h"
+#include "../include/proxy_ptr/proxy_algorithm.h"
 #include <iostream>
 #include <chrono>
+#include <algorithm>
 #include <array>
+#include <cstring>
+#include <filesystem>
 #include <set>
 #include <unordered_set>
 #include <thread>
+#include <vector>
 
 double get_time() {
     return std::chrono::duration<double>(
@@ -25,6 +37,55 @@ void execute_print_time(const std::string& name, int times, Func f) {
     std::cout << name << ": finish in " << time << std::endl;
 }
 
+// the checks that didn't hold, main() fails when there are any
+int failed_checks = 0;
+
+void expect(const std::string& what, bool ok) {
+    std::cout << "expecting " << what << ": " << (ok ? "ok" : "FAILED")
+              << std::endl;
+    if (!ok)
+        failed_checks++;
+}
+
+struct DeferredTracedTest {
+    static inline int destroyed = 0;
+    int id;
+    DeferredTracedTest(int _id) : id(_id) {}
+    ~DeferredTracedTest() {
+        std::cout << "~DeferredTracedTest " << id << std::endl;
+        destroyed++;
+    }
+};
+template <>
+struct proxy::proxy_deferred_delete<DeferredTracedTest> : std::true_type {};
+
+struct KillBenchTest {
+    std::string name = std::string(100, 'x');
+};
+struct DeferredBenchTest : KillBenchTest {};
+template <>
+struct proxy::proxy_deferred_delete<DeferredBenchTest> : std::true_type {};
+
+struct PooledSpawnTest {
+    std::string name;
+    int id;
+    PooledSpawnTest(const char* _name, int _id) : name(_name), id(_id) {}
+};
+template <> struct proxy::proxy_use_pool<PooledSpawnTest> : std::true_type {};
+
+#if defined(_MSC_VER)
+    #define NOINLINE __declspec(noinline)
+#else
+    #define NOINLINE __attribute__((noinline))
+#endif
+
+NOINLINE int by_value_call(proxy::proxy_ptr<int, proxy::proxy_atomic> ptr) {
+    return ptr.alive() ? *ptr : 0;
+}
+NOINLINE int by_ref_call(proxy::proxy_ref<int, proxy::proxy_atomic> ptr) {
+    return ptr.alive() ? *ptr : 0;
+}
+
 void BenchTest() {
 #ifdef _DEBUG
     constexpr auto TIMES = 2000;
@@ -58,6 +119,213 @@ void BenchTest() {
                     std::cout << "what the hell\n";
         return root.hashkey();
     });
+
+    execute_print_time("proxy biased >> huge copy", TIMES, []() {
+        auto root = proxy::make_proxy_biased<char[]>(100000);
+        for (int i = 0; i < 100000; i++)
+            if (auto copy = root)
+                if (copy.hashkey() != root.hashkey())
+                    std::cout << "what the hell\n";
+        return root.hashkey();
+    });
+
+    execute_print_time("proxy atomic >> by value call", TIMES, []() {
+        auto root = proxy::make_proxy_atomic<int>(1);
+        int sum = 0;
+        for (int i = 0; i < 100000; i++)
+            sum += by_value_call(root);
+        return sum;
+    });
+
+    execute_print_time("proxy atomic >> proxy_ref call", TIMES, []() {
+        auto root = proxy::make_proxy_atomic<int>(1);
+        int sum = 0;
+        for (int i = 0; i < 100000; i++)
+            sum += by_ref_call(root);
+        return sum;
+    });
+
+    execute_print_time("proxy atomic >> copy swap", TIMES, []() {
+        auto first = proxy::make_proxy_atomic<std::string>("monkey1");
+        auto second = proxy::make_proxy_atomic<std::string>("monkey2");
+        for (int i = 0; i < 100000; i++) {
+            auto tmp = first;
+            first = second;
+            second = tmp;
+        }
+        return first.hashkey();
+    });
+
+    execute_print_time("proxy atomic >> move swap", TIMES, []() {
+        auto first = proxy::make_proxy_atomic<std::string>("monkey1");
+        auto second = proxy::make_proxy_atomic<std::string>("monkey2");
+        for (int i = 0; i < 100000; i++)
+            std::swap(first, second);
+        return first.hashkey();
+    });
+
+    execute_print_time("proxy atomic >> vector growth", TIMES / 10, []() {
+        auto root = proxy::make_proxy_atomic<std::string>("monkey");
+        std::vector<proxy::proxy_ptr<std::string, proxy::proxy_atomic>> list;
+        for (int i = 0; i < 10000; i++)
+            list.push_back(root);
+        return list.size();
+    });
+
+    struct HotTest {
+        int value = 1;
+    };
+
+    const auto max_threads =
+        std::max(4u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        auto run = [threads](const std::string& name, auto root, auto read) {
+            auto start = get_time();
+            std::vector<std::thread> workers;
+            for (unsigned i = 0; i < threads; i++)
+                workers.emplace_back([&root, &read]() {
+                    int sum = 0;
+                    for (int j = 0; j < TIMES * 50; j++)
+                        sum += read(root);
+                    if (sum != TIMES * 50)
+                        std::cout << "what the hell\n";
+                });
+            for (auto& worker : workers)
+                worker.join();
+            std::cout << name << " x" << threads << ": finish in "
+                      << get_time() - start << std::endl;
+        };
+
+        run("proxy atomic >> shared read copy",
+            proxy::make_proxy_atomic<HotTest>(), [](auto& root) {
+                auto copy = root;
+                return copy->value;
+            });
+
+        run("proxy epoch >> shared read", proxy::make_proxy_epoch<HotTest>(),
+            [](auto& root) {
+                auto guard = proxy::proxy_epoch_domain::global().read();
+                return root->value;
+            });
+    }
+
+    struct DomainBenchTest {
+        int id;
+    };
+
+    // only the expiring part is timed
+    double deleting = 0, invalidating = 0;
+    for (int i = 0; i < TIMES / 10; i++) {
+        proxy::proxy_domain<> domain;
+        std::vector<proxy::proxy_ptr<DomainBenchTest>> list, grouped;
+        for (int j = 0; j < 10000; j++) {
+            list.push_back(proxy::make_proxy<DomainBenchTest>());
+            grouped.push_back(domain.make<DomainBenchTest>());
+        }
+
+        auto start = get_time();
+        for (auto& elem : list)
+            elem.proxy_delete();
+        deleting += get_time() - start;
+
+        start = get_time();
+        domain.invalidate_all();
+        invalidating += get_time() - start;
+    }
+    std::cout << "proxy >> proxy_delete one by one: finish in " << deleting
+              << std::endl;
+    std::cout << "proxy domain >> invalidate_all: finish in " << invalidating
+              << std::endl;
+
+    // the latency of a kill storm inside the tick, the deferred deleters
+    // run later at the safe point
+    double inline_kill = 0, deferred_kill = 0;
+    for (int i = 0; i < TIMES / 10; i++) {
+        std::vector<proxy::proxy_ptr<KillBenchTest>> list;
+        std::vector<proxy::proxy_ptr<DeferredBenchTest>> deferred;
+        for (int j = 0; j < 1000; j++) {
+            list.push_back(proxy::make_proxy<KillBenchTest>());
+            deferred.push_back(proxy::make_proxy<DeferredBenchTest>());
+        }
+
+        auto start = get_time();
+        for (auto& elem : list)
+            elem.proxy_delete();
+        inline_kill += get_time() - start;
+
+        start = get_time();
+        for (auto& elem : deferred)
+            elem.proxy_delete();
+        deferred_kill += get_time() - start;
+        proxy::proxy_drain_deletes();
+    }
+    std::cout << "proxy >> inline kill storm: finish in " << inline_kill
+              << std::endl;
+    std::cout << "proxy >> deferred kill storm: finish in " << deferred_kill
+              << std::endl;
+
+    std::vector<proxy::proxy_ptr<int>> keys;
+    for (int i = 0; i < 10000; i++)
+        keys.push_back(proxy::make_proxy<int>(i));
+
+    execute_print_time("unordered_set >> lookup", TIMES / 100, [&keys]() {
+        std::unordered_set<proxy::proxy_ptr<int>> table(keys.begin(),
+                                                        keys.end());
+        size_t found = 0;
+        for (int i = 0; i < 10; i++)
+            for (auto& key : keys)
+                found += table.count(key);
+        return found;
+    });
+
+    execute_print_time("proxy_flat_set >> lookup", TIMES / 100, [&keys]() {
+        proxy::proxy_flat_set<int> table;
+        for (auto& key : keys)
+            table.insert(key);
+        size_t found = 0;
+        for (int i = 0; i < 10; i++)
+            for (auto& key : keys)
+                found += table.contains(key);
+        return found;
+    });
+
+    struct SpawnTest {
+        std::string name;
+        int id;
+        SpawnTest(const char* _name, int _id) : name(_name), id(_id) {}
+    };
+
+    execute_print_time("proxy >> two allocations make", TIMES, []() {
+        for (int i = 0; i < 100; i++) {
+            proxy::proxy_ptr<SpawnTest> root{new SpawnTest("monkey", i)};
+            if (root->id != i)
+                std::cout << "what the hell\n";
+        }
+    });
+
+    execute_print_time("proxy >> single allocation make", TIMES, []() {
+        for (int i = 0; i < 100; i++) {
+            auto root = proxy::make_proxy<SpawnTest>("monkey", i);
+            if (root->id != i)
+                std::cout << "what the hell\n";
+        }
+    });
+
+    execute_print_time("proxy >> pooled make", TIMES, []() {
+        for (int i = 0; i < 100; i++) {
+            auto root = proxy::make_proxy<PooledSpawnTest>("monkey", i);
+            if (root->id != i)
+                std::cout << "what the hell\n";
+        }
+    });
+
+    execute_print_time("proxy atomic >> pooled make", TIMES, []() {
+        for (int i = 0; i < 100; i++) {
+            auto root = proxy::make_proxy_atomic<PooledSpawnTest>("monkey", i);
+            if (root->id != i)
+                std::cout << "what the hell\n";
+        }
+    });
 }
 
 void PrintTest() {
@@ -111,6 +379,238 @@ void PrintSharedTest() {
     std::cout << "root ptr " << root.get() << std::endl;
 }
 
+void MakeProxyTest() {
+    struct TracedTest {
+        int* destroyed;
+        TracedTest(int* _destroyed) : destroyed(_destroyed) {}
+        ~TracedTest() { (*destroyed)++; }
+    };
+
+    int destroyed = 0;
+    auto root = proxy::make_proxy<TracedTest>(&destroyed);
+    auto root2 = root;
+    root.proxy_delete();
+    expect("~TracedTest before the proxies expire",
+           destroyed == 1 && !root.alive() && !root2.alive());
+    std::cout << "root2 hashkey " << root2.hashkey() << std::endl;
+
+    // the released object is moved out of the block, the caller owns it
+    struct ValueTest {
+        int value = 7;
+    };
+    auto value = proxy::make_proxy<ValueTest>();
+    auto copy = value;
+    ValueTest* released = value.proxy_release();
+    value = nullptr;
+    copy = nullptr;
+    expect("7, expired", released->value == 7 && !value.alive());
+    delete released;
+}
+
+void ForwardingTest() {
+    struct MoveOnlyTest {
+        std::unique_ptr<std::string> name;
+        MoveOnlyTest(std::unique_ptr<std::string> _name)
+            : name(std::move(_name)) {}
+    };
+
+    auto name = std::make_unique<std::string>("monkey");
+    auto root = proxy::make_proxy<MoveOnlyTest>(std::move(name));
+    expect("name moved", !name && *root->name == "monkey");
+
+    auto buffer = proxy::make_proxy_for_overwrite<char[]>(16);
+    buffer[0] = 'x';
+    expect("buffer[0] x", buffer[0] == 'x');
+
+    auto atomic =
+        proxy::proxy_factory<std::string, proxy::proxy_atomic>::make("monkey");
+    expect("atomic monkey", *atomic == "monkey");
+}
+
+void PoolTest() {
+    // the blocks of the other tests are counted too
+    auto local = []() {
+        return proxy::get_proxy_pool_stats<proxy::proxy_non_atomic>().in_use;
+    };
+    auto global = []() {
+        return proxy::get_proxy_pool_stats<proxy::proxy_atomic>().in_use;
+    };
+
+    const auto local_before = local();
+    const auto global_before = global();
+    {
+        auto first = proxy::make_proxy<PooledSpawnTest>("monkey1", 1);
+        auto second = proxy::make_proxy<PooledSpawnTest>("monkey2", 2);
+        expect("2 in use", local() - local_before == 2);
+    }
+    expect("0 in use", local() == local_before);
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < 4; i++)
+        workers.emplace_back([i]() {
+            for (int j = 0; j < 1000; j++)
+                auto root =
+                    proxy::make_proxy_atomic<PooledSpawnTest>("monkey", i);
+        });
+    for (auto& worker : workers)
+        worker.join();
+    expect("0 in use by the threads", global() == global_before);
+}
+
+void PinTest() {
+    struct WorkTest {
+        std::atomic<int> reads{0};
+        int* destroyed;
+        WorkTest(int* _destroyed) : destroyed(_destroyed) {}
+        ~WorkTest() { (*destroyed)++; }
+    };
+
+    int destroyed = 0;
+    auto root = proxy::make_proxy_atomic<WorkTest>(&destroyed);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < 4; i++)
+        workers.emplace_back([copy = root]() {
+            // the object can't be deleted while it's pinned
+            while (auto pin = copy.pin())
+                pin->reads++;
+        });
+
+    auto pin = root.lock();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    root.proxy_delete();
+    // how many reads the workers made depends on the scheduler
+    std::cout << "reads " << pin->reads << std::endl;
+    expect("root expired but still readable",
+           !root.alive() && pin && destroyed == 0);
+    for (auto& worker : workers)
+        worker.join();
+
+    pin = {};
+    expect("~WorkTest when the last pin goes away", destroyed == 1);
+    expect("empty pin", !root.pin());
+}
+
+void EpochTest() {
+    struct EpochTracedTest {
+        int* destroyed;
+        EpochTracedTest(int* _destroyed) : destroyed(_destroyed) {}
+        ~EpochTracedTest() { (*destroyed)++; }
+    };
+
+    int destroyed = 0;
+    auto& domain = proxy::proxy_epoch_domain::global();
+    auto root = proxy::make_proxy_epoch<EpochTracedTest>(&destroyed);
+    {
+        auto guard = domain.read();
+        auto ptr = root.get();
+        root.proxy_delete();
+        domain.collect();
+        domain.collect();
+        expect("root expired and still reclaimable",
+               !root.alive() && domain.pending() > 0 && ptr &&
+                   destroyed == 0);
+    }
+
+    domain.collect();
+    domain.collect();
+    expect("~EpochTracedTest once the reader left",
+           destroyed == 1 && domain.pending() == 0);
+}
+
+void BiasedTest() {
+    struct BiasedTracedTest {
+        int* destroyed;
+        BiasedTracedTest(int* _destroyed) : destroyed(_destroyed) {}
+        ~BiasedTracedTest() { (*destroyed)++; }
+    };
+
+    int destroyed = 0;
+    auto root = proxy::make_proxy_biased<BiasedTracedTest>(&destroyed);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < 4; i++)
+        workers.emplace_back([copy = root]() mutable {
+            for (int j = 0; j < 1000; j++)
+                auto tmp = copy;
+            // released by a thread that isn't the owner
+            copy = nullptr;
+        });
+    for (auto& worker : workers)
+        worker.join();
+
+    // the worker references are settled by the owner
+    root = nullptr;
+    const auto flushed = proxy::proxy_biased_flush();
+    std::cout << "flushed " << flushed << std::endl;
+    expect("~BiasedTracedTest on flush", destroyed == 1);
+}
+
+void DeferredDeleteTest() {
+    const auto destroyed = DeferredTracedTest::destroyed;
+    std::vector<proxy::proxy_ptr<DeferredTracedTest>> list;
+    for (int i = 0; i < 3; i++)
+        list.push_back(proxy::make_proxy<DeferredTracedTest>(i));
+    for (auto& elem : list)
+        elem.proxy_delete();
+    expect("expired and 3 pending",
+           !list[0].alive() && proxy::proxy_pending_deletes() == 3);
+
+    // the proxies aren't needed for the deleters to run
+    list.clear();
+    proxy::proxy_drain_deletes(std::chrono::nanoseconds(0));
+    expect("~DeferredTracedTest 0",
+           DeferredTracedTest::destroyed - destroyed == 1);
+    proxy::proxy_drain_deletes();
+    expect("the other two, 0 pending",
+           DeferredTracedTest::destroyed - destroyed == 3 &&
+               proxy::proxy_pending_deletes() == 0);
+}
+
+void DeletionGuardTest() {
+    struct GuardedTest {
+        int id;
+        std::vector<int>* destroyed;
+        GuardedTest(int _id, std::vector<int>* _destroyed)
+            : id(_id), destroyed(_destroyed) {}
+        ~GuardedTest() { destroyed->push_back(id); }
+    };
+
+    std::vector<int> destroyed;
+    std::vector<proxy::proxy_ptr<GuardedTest>> list;
+    for (int i = 0; i < 4; i++)
+        list.push_back(proxy::make_proxy<GuardedTest>(i, &destroyed));
+    {
+        proxy::deletion_guard guard;
+        int sum = 0;
+        for (auto& elem : list) {
+            if (!elem.alive())
+                continue;
+            // whatever the loop deletes stays around until the guard closes
+            list[3].proxy_delete();
+            sum += elem.get_unchecked()->id;
+            sum += elem.get_unchecked()->id;
+        }
+        {
+            proxy::deletion_guard nested;
+            list[1] = nullptr;
+        }
+        expect("6, 2 pending, 0 alive",
+               sum == 6 && proxy::deletion_guard::pending() == 2 &&
+                   !list[3].alive() && destroyed.empty());
+    }
+    expect("~GuardedTest 3 then 1, 0 pending",
+           destroyed == std::vector<int>{3, 1} &&
+               proxy::deletion_guard::pending() == 0);
+
+    // a deferred type goes to proxy_drain_deletes() once the guard closes
+    auto deferred = proxy::make_proxy<DeferredTracedTest>(7);
+    {
+        proxy::deletion_guard guard;
+        deferred.proxy_delete();
+    }
+    expect("1 deferred", proxy::proxy_pending_deletes() == 1);
+    proxy::proxy_drain_deletes();
+}
+
 void GetPtrTest() {
     auto root = proxy::make_proxy<std::string>("monkey");
     auto root2 = root;
@@ -200,6 +700,104 @@ class DerivedProxyTest : public BaseProxyTest {
     ~DerivedProxyTest() { std::cout << "~DerivedProxyTest" << std::endl; }
 };
 
+void TransparentHashTest() {
+    std::unordered_set<proxy::proxy_ptr<std::string>, proxy::proxy_hash,
+                       proxy::proxy_equal>
+        setList;
+    std::set<proxy::proxy_ptr<std::string>, proxy::proxy_less> sortedList;
+    auto elem1 = proxy::make_proxy<std::string>("monkey1");
+    auto elem2 = proxy::make_proxy<std::string>("monkey2");
+    setList.insert(elem1);
+    sortedList.insert(elem1);
+
+    // no temporary proxy is made for the lookups
+    std::string* raw = elem1.get();
+    proxy::proxy_ref<std::string> ref = elem1;
+    expect("found by raw pointer and proxy_ref",
+           setList.find(raw) != setList.end() &&
+               setList.find(ref) != setList.end() &&
+               sortedList.find(raw) != sortedList.end());
+    expect("not found", setList.find(elem2.get()) == setList.end() &&
+                            sortedList.find(elem2.get()) == sortedList.end());
+
+    // the hash doesn't change once expired
+    elem1.proxy_delete();
+    expect("found after proxy_delete", setList.find(raw) != setList.end());
+
+    // a base at a non-zero offset is compared in the base pointer type
+    struct FirstTest {
+        int first = 1;
+    };
+    struct SecondTest {
+        int second = 2;
+    };
+    struct BothTest : FirstTest, SecondTest {};
+    auto both = proxy::make_proxy<BothTest>();
+    auto second = proxy::static_pointer_cast<SecondTest>(both);
+    std::unordered_set<proxy::proxy_ptr<SecondTest>,
+                       proxy::basic_proxy_hash<SecondTest>, proxy::proxy_equal>
+        baseList;
+    std::set<proxy::proxy_ptr<SecondTest>, proxy::proxy_less> sortedBase;
+    baseList.insert(second);
+    sortedBase.insert(second);
+    expect("equal and found by derived",
+           both == second && proxy::proxy_equal()(both, second) &&
+               baseList.find(both) != baseList.end() &&
+               baseList.find(both.get()) != baseList.end() &&
+               sortedBase.find(both) != sortedBase.end());
+}
+
+void FlatMapTest() {
+    proxy::proxy_flat_map<std::string, int> aggro;
+    proxy::proxy_flat_set<std::string> near;
+    std::vector<proxy::proxy_ptr<std::string>> list;
+    for (int i = 0; i < 100; i++) {
+        list.push_back(proxy::make_proxy<std::string>("monkey"));
+        aggro[list.back()] = i;
+        near.insert(list.back());
+    }
+    proxy::proxy_ref<std::string> ref = list[10];
+    expect("100 100 10", aggro.size() == 100 && near.size() == 100 &&
+                             aggro.find(ref)->second == 10);
+
+    // half of them die, the tables drop them by themselves
+    for (int i = 0; i < 100; i += 2)
+        list[i].proxy_delete();
+    int alive = 0;
+    for (auto& entry : aggro)
+        alive += entry.first.alive();
+    expect("50 alive when iterating", alive == 50);
+    expect("not found",
+           !aggro.contains(list[0]) && near.find(list[0]) == near.end());
+
+    // the keys are read only, and the lookups keep the iterators valid
+    static_assert(std::is_const_v<decltype(aggro.begin()->first)>);
+    auto kept = aggro.find(list[11]);
+    const auto missing = aggro.find(list[12]) == aggro.end();
+    expect("11, not found", kept->second == 11 && missing);
+
+    near.purge_expired(16);
+    std::cout << "purged by budget " << 100 - near.size() << std::endl;
+    near.purge_expired();
+    aggro.purge_expired();
+    expect("50 50", aggro.size() == 50 && near.size() == 50);
+
+    auto copy = aggro;
+    expect("11 in the copy", copy[list[11]] == 11);
+
+    // another owner can expire the key, operator[] can't make an entry
+    auto key = list[13];
+    key.proxy_delete();
+    bool thrown = false;
+    try {
+        copy[key] = 5;
+    } catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    expect("thrown, no entry for the expired key",
+           thrown && !copy.try_emplace(key, 5).second);
+}
+
 void InheritTest() {
     auto derived = proxy::make_proxy<DerivedProxyTest>();
     auto derived2 =
@@ -213,6 +811,83 @@ void InheritTest() {
         std::cout << "derived2 is no longer alive." << std::endl;
 }
 
+void MoveTest() {
+    auto derived = proxy::make_proxy<DerivedProxyTest>();
+    auto moved = std::move(derived);
+    expect("derived expired and moved alive",
+           !derived.alive() && moved.alive());
+
+    proxy::proxy_ptr<BaseProxyTest> base = std::move(moved);
+    expect("moved expired and base alive", !moved.alive() && base.alive());
+
+    proxy::proxy_ptr<BaseProxyTest> other;
+    other.swap(base);
+    expect("base expired and other alive", !base.alive() && other.alive());
+    other.proxy_delete();
+
+    // the arrays only gain cv-qualifiers, they never convert to an object
+    static_assert(!std::is_convertible_v<proxy::proxy_ptr<DerivedProxyTest[]>,
+                                         proxy::proxy_ptr<BaseProxyTest>>);
+    static_assert(!std::is_convertible_v<proxy::proxy_ptr<DerivedProxyTest[]>,
+                                         proxy::proxy_ptr<BaseProxyTest[]>>);
+    static_assert(!std::is_convertible_v<proxy::proxy_ptr<int[]>,
+                                         proxy::proxy_ptr<int>>);
+    static_assert(!std::is_convertible_v<proxy::proxy_ptr<int>,
+                                         proxy::proxy_ptr<int[]>>);
+    static_assert(!std::is_constructible_v<
+                  proxy::proxy_ref<BaseProxyTest>,
+                  const proxy::proxy_ptr<DerivedProxyTest[]>&>);
+    proxy::proxy_ptr<const int[]> values = proxy::make_proxy<int[]>(4);
+    expect("int[] moved to const int[]", values.alive());
+}
+
+void RefTest() {
+    auto root = proxy::make_proxy<DerivedProxyTest>();
+    proxy::proxy_ref<BaseProxyTest> ref = root;
+    expect("ref alive", ref.alive() && ref.get() == root.get());
+
+    // the callee keeping it takes a reference
+    auto kept = ref.proxy();
+    root = nullptr;
+    expect("kept alive", kept.alive());
+
+    ref = kept;
+    kept.proxy_delete();
+    expect("ref expired", !ref.alive() && !ref.pin());
+}
+
+void ExpireHookTest() {
+    struct WatcherTest {
+        proxy::proxy_expire_hook<> hook;
+        int fired = 0;
+        static void on_expire(void* self) {
+            static_cast<WatcherTest*>(self)->fired++;
+        }
+    };
+    struct ParentTest : proxy::proxy_parent_base<ParentTest> {};
+
+    WatcherTest first, second, third;
+    auto root = proxy::make_proxy<std::string>("monkey");
+    first.hook.attach(root, &WatcherTest::on_expire, &first);
+    second.hook.attach(root, &WatcherTest::on_expire, &second);
+    second.hook.detach();
+    root.proxy_delete();
+    root.proxy_delete();
+    expect("fired once and not fired", first.fired == 1 &&
+                                           second.fired == 0 &&
+                                           !first.hook.attached());
+
+    // too late, it runs right away
+    second.hook.attach(root, &WatcherTest::on_expire, &second);
+    expect("fired", second.fired == 1);
+
+    {
+        ParentTest object;
+        third.hook.attach(object.proxy(), &WatcherTest::on_expire, &third);
+    }
+    expect("fired by ~proxy_parent_base", third.fired == 1);
+}
+
 void ParentBaseDeleteTest() {
     struct ParentBaseTest : proxy::proxy_parent_base<ParentBaseTest> {};
     struct DerivedTest : ParentBaseTest {};
@@ -252,6 +927,29 @@ void ParentBaseDeleteTest() {
     }
 }
 
+struct LazyParentTest : proxy::proxy_parent_base<LazyParentTest> {};
+template <> struct proxy::proxy_use_pool<LazyParentTest> : std::true_type {};
+
+void LazyParentBaseTest() {
+    using ParentBaseTest = LazyParentTest;
+    auto in_use = []() {
+        return proxy::get_proxy_pool_stats<proxy::proxy_non_atomic>().in_use;
+    };
+
+    auto before = in_use();
+    ParentBaseTest object;
+    expect("no state allocated", in_use() == before);
+
+    auto pr1 = object.proxy();
+    object.proxy_delete();
+    auto pr2 = object.proxy();
+    expect("0-1", !pr1.alive() && pr2.alive());
+    expect("2 states allocated", in_use() - before == 2);
+
+    auto copy = object;
+    expect("different proxies", copy.proxy() != object.proxy());
+}
+
 class ValidBaseTest : public proxy::enable_proxy_from_this<ValidBaseTest> {
    public:
     std::string name;
@@ -379,7 +1077,7 @@ class CharLinkTest {
 
 class PartyTest : public proxy::enable_proxy_from_this<PartyTest> {
    public:
-    void Link(proxy::proxy_ptr<CharLinkTest> ch) {
+    void Link(proxy::proxy_ref<CharLinkTest> ch) {
         ch->party = proxy_from_this();
         std::cout << "INLINK ptr " << ch->party.get() << " hashkey "
                   << ch->party.hashkey() << " alive " << ch->party.alive()
@@ -416,6 +1114,418 @@ class RawMemoryClass : public proxy::enable_proxy_from_this<RawMemoryClass> {
 };
 
 
+class IntrusiveEntityTest
+    : public proxy::proxy_intrusive_base<IntrusiveEntityTest> {
+   public:
+    std::string name;
+    IntrusiveEntityTest(std::string _name) : name(_name) {}
+};
+
+class IntrusiveCharacterTest : public IntrusiveEntityTest {
+   public:
+    int id;
+    IntrusiveCharacterTest(std::string _name, int _id)
+        : IntrusiveEntityTest(_name), id(_id) {}
+};
+
+void IntrusiveTest() {
+    auto obj = new IntrusiveCharacterTest("Thicc", 1);
+    auto entity = obj->proxy();
+    auto character = obj->proxy_from_base<IntrusiveCharacterTest>();
+    expect("Thicc 1 alive", character->name == "Thicc" &&
+                                character->id == 1 && entity.alive());
+
+    // the storage of obj stays around until entity and character detach
+    const void* key = character.hashkey();
+    delete obj;
+    expect("both expired, same hashkey",
+           !entity.get() && !character.get() && character.hashkey() == key);
+
+    // no proxies left: the storage is released right away
+    IntrusiveEntityTest stack("Stack");
+    {
+        auto proxy = stack.proxy();
+        expect("Stack", proxy->name == "Stack");
+    }
+    delete new IntrusiveEntityTest("Heap");
+
+    // the over-aligned objects keep their tombstone as well
+    struct alignas(64) AlignedIntrusiveTest
+        : proxy::proxy_intrusive_base<AlignedIntrusiveTest> {
+        int value = 5;
+    };
+    auto aligned = new AlignedIntrusiveTest;
+    auto proxy = aligned->proxy();
+    expect("aligned 5",
+           reinterpret_cast<std::uintptr_t>(aligned) % 64 == 0 &&
+               proxy->value == 5);
+    const auto aligned_key = proxy.hashkey();
+    delete aligned;
+    expect("expired, same hashkey",
+           !proxy.alive() && proxy.hashkey() == aligned_key);
+}
+
+class HandleEntityTest : public proxy::enable_proxy_from_this<HandleEntityTest>,
+                         public proxy::proxy_handle_base<HandleEntityTest> {
+   public:
+    int id;
+    HandleEntityTest(proxy::proxy_registry<HandleEntityTest>& registry,
+                     int _id)
+        : proxy::proxy_handle_base<HandleEntityTest>(registry), id(_id) {}
+};
+
+void HandleTest() {
+    proxy::proxy_registry<HandleEntityTest> registry;
+    proxy::proxy_handle<HandleEntityTest> handle;
+    {
+        HandleEntityTest entity(registry, 1);
+        handle = entity.handle();
+        auto proxy = registry.proxy(handle);
+        expect("id 1, alive, 1 slot", registry.resolve(handle)->id == 1 &&
+                                          proxy.alive() &&
+                                          registry.size() == 1);
+    }
+    expect("resolved to nullptr, 0 slots",
+           !registry.resolve(handle) && registry.size() == 0);
+
+    // the slot is reused with a new generation
+    HandleEntityTest entity(registry, 2);
+    auto handle2 = entity.handle();
+    expect("same index and stale handle",
+           handle.index() == handle2.index() && !registry.contains(handle));
+}
+
+void DomainTest() {
+    struct DomainTracedTest {
+        int id;
+        int* destroyed;
+        DomainTracedTest(int _id, int* _destroyed)
+            : id(_id), destroyed(_destroyed) {}
+        ~DomainTracedTest() { (*destroyed)++; }
+    };
+
+    int destroyed = 0;
+    proxy::proxy_domain<> dungeon;
+    std::vector<proxy::proxy_ptr<DomainTracedTest>> mobs;
+    for (int i = 0; i < 3; i++)
+        mobs.push_back(dungeon.make<DomainTracedTest>(i, &destroyed));
+    auto copy = mobs[0];
+
+    dungeon.invalidate_all();
+    auto boss = dungeon.make<DomainTracedTest>(3, &destroyed);
+    expect("mobs expired and boss alive", !mobs[0].alive() &&
+                                              !mobs[1].alive() &&
+                                              !copy.alive() && boss.alive());
+
+    dungeon.sweep(1);
+    expect("one ~DomainTracedTest", destroyed == 1);
+    dungeon.sweep();
+    expect("the other two, no expired left",
+           destroyed == 3 && !dungeon.has_expired());
+    mobs.clear();
+    boss = nullptr;
+    expect("~DomainTracedTest 3 with its last proxy", destroyed == 4);
+}
+
+void StatsTest() {
+    struct StatsCountedTest {
+        int value = 0;
+    };
+    auto find = [](const proxy::proxy_stats_snapshot& snapshot) {
+        for (auto& type : snapshot.types)
+            if (std::strcmp(type.name, typeid(StatsCountedTest).name()) == 0)
+                return type;
+        return proxy::proxy_type_stats{};
+    };
+
+    if (!proxy::proxy_stats_enabled) {
+        expect("no types, PROXY_PTR_STATS is off",
+               proxy::stats().types.empty());
+        return;
+    }
+
+    auto root = proxy::make_proxy<StatsCountedTest>();
+    auto copy = root;
+    root.proxy_delete();
+    auto counted = find(proxy::stats());
+    std::cout << "zombie bytes " << counted.zombie_bytes << std::endl;
+    expect("1 live, 1 zombie, 1 delete", counted.live == 1 &&
+                                             counted.zombies == 1 &&
+                                             counted.proxy_delete == 1);
+
+    root = nullptr;
+    copy = nullptr;
+    counted = find(proxy::stats());
+    expect("0 live, 0 zombies, balanced refs",
+           counted.live == 0 && counted.zombies == 0 &&
+               counted.inc_ref == counted.dec_ref);
+}
+
+void TraceTest() {
+    struct TraceCountedTest {
+        int value = 0;
+    };
+
+    if (!proxy::proxy_trace_enabled) {
+        expect("no events, PROXY_PTR_TRACE is off",
+               proxy::proxy_trace_snapshot().empty());
+        return;
+    }
+
+    proxy::proxy_trace_clear();
+    const void* block = nullptr;
+    {
+        auto root = proxy::make_proxy<TraceCountedTest>();
+        block = root._state();
+        auto copy = root;
+        root.proxy_delete();
+    }
+
+    std::string ops;
+    for (auto& event : proxy::proxy_trace_snapshot()) {
+        if (event.block == block)
+            ops += std::string(" ") + proxy::proxy_trace_op_name(event.op);
+    }
+    std::cout << "ops" << ops << std::endl;
+    expect("create copy copy proxy_delete detach detach last_detach",
+           ops == " create copy copy proxy_delete detach detach last_detach");
+    // the dump goes to the temporary directory and is removed once read
+    const auto path =
+        (std::filesystem::temp_directory_path() / "proxy_trace_test.csv")
+            .string();
+    const bool dumped = proxy::proxy_trace_dump(path.c_str());
+    std::FILE* file = std::fopen(path.c_str(), "r");
+    char header[64] = {};
+    const bool read = file && std::fgets(header, sizeof(header), file);
+    if (file)
+        std::fclose(file);
+    std::remove(path.c_str());
+    expect("dumped with the csv header",
+           dumped && read &&
+               std::strcmp(header, "time_ns,thread,op,block,type\n") == 0);
+}
+
+void Ptr32Test() {
+    struct BaseTest {
+        virtual ~BaseTest() = default;
+        int base = 1;
+    };
+    struct DerivedTest : BaseTest {
+        int derived = 2;
+    };
+
+    auto root = proxy::make_proxy32<DerivedTest>();
+    proxy::proxy_ptr32<const DerivedTest> back = root;
+    proxy::proxy_ptr<BaseTest> base = root.proxy();
+    expect("4 bytes, alive, same block", sizeof(root) == 4 &&
+                                             root.alive() && back.alive() &&
+                                             back == root && base.alive());
+
+    auto full = root.proxy();
+    {
+        auto guard = root.pin();
+        root.proxy_delete();
+        expect("expired but still pinned",
+               !root.alive() && !full.alive() && guard->derived == 2);
+    }
+
+    // the slot is recycled once the last proxy is gone
+    const auto index = root.index();
+    root = nullptr;
+    base = nullptr;
+    back = nullptr;
+    full = nullptr;
+    auto next = proxy::make_proxy32<DerivedTest>();
+    expect("the slot reused", next.index() == index);
+
+    // a base can be at a non zero offset, it needs the adjusted pointer
+    // of a proxy_ptr
+    struct FirstTest {
+        int first = 1;
+    };
+    struct SecondTest {
+        int second = 2;
+    };
+    struct BothTest : FirstTest, SecondTest {};
+    static_assert(!std::is_convertible_v<proxy::proxy_ptr32<BothTest>,
+                                         proxy::proxy_ptr32<SecondTest>>);
+    static_assert(!std::is_convertible_v<proxy::proxy_ptr32<DerivedTest>,
+                                         proxy::proxy_ptr32<BaseTest>>);
+    auto both = proxy::make_proxy32<BothTest>();
+    proxy::proxy_ptr<SecondTest> second = both.proxy();
+    auto again = proxy::static_pointer_cast<BothTest>(second);
+    expect("2, same object",
+           second->second == 2 && again.get() == both.get());
+    both.proxy_delete();
+
+    std::vector<proxy::proxy_ptr32<int>> many;
+    for (int i = 0; i < 5000; i++)
+        many.push_back(proxy::make_proxy32<int>(i));
+    bool valid = true;
+    for (int i = 0; i < 5000; i++)
+        valid = valid && *many[i] == i;
+    expect("valid across the chunks", valid);
+}
+
+void AliasingTest() {
+    struct FirstTest {
+        virtual ~FirstTest() = default;
+        int first = 1;
+    };
+    struct SecondTest {
+        virtual ~SecondTest() = default;
+        int second = 2;
+    };
+    struct BothTest : FirstTest, SecondTest {
+        int both = 3;
+    };
+    struct VirtualTest : virtual SecondTest {
+        int more = 4;
+    };
+
+    // the second base lives at a non zero offset
+    auto both = proxy::make_proxy<BothTest>();
+    auto second = proxy::static_pointer_cast<SecondTest>(both);
+    proxy::proxy_ptr<SecondTest> converted = proxy::make_proxy<BothTest>();
+    expect("2 2, the adjusted pointer",
+           second->second == 2 && converted->second == 2 &&
+               second.get() == static_cast<SecondTest*>(both.get()));
+
+    auto back = proxy::dynamic_pointer_cast<BothTest>(second);
+    proxy::proxy_ref<SecondTest> ref = both;
+    expect("3 2 2, same object",
+           back->both == 3 && ref->second == 2 && ref.proxy()->second == 2 &&
+               back == both && ref.pin()->second == 2);
+
+    auto virt = proxy::make_proxy<VirtualTest>();
+    auto vbase = proxy::static_pointer_cast<SecondTest>(virt);
+    expect("2 4 through a virtual base",
+           vbase->second == 2 &&
+               proxy::dynamic_pointer_cast<VirtualTest>(vbase)->more == 4);
+
+    // a member of the object, sharing its lifetime
+    proxy::proxy_ptr<int> member(&both->both, both);
+    second.proxy_delete();
+    expect("all expired", !both.alive() && !back.alive() &&
+                              !member.alive() && !ref.alive());
+
+    // the casts of an expired proxy keep its hashkey
+    auto expired = proxy::static_pointer_cast<SecondTest>(both);
+    auto restored = proxy::static_pointer_cast<BothTest>(expired);
+    auto constant = proxy::const_pointer_cast<const BothTest>(restored);
+    expect("the same hashkeys", expired.hashkey() == second.hashkey() &&
+                                    restored == both && constant == both);
+    expect("16 bytes", sizeof(both) == 16);
+
+    // an expired object has no vptr left to find its virtual base
+    auto dead = proxy::make_proxy<VirtualTest>();
+    auto kept = dead;
+    dead.proxy_delete();
+    proxy::proxy_ref<SecondTest> dead_ref = kept;
+    proxy::proxy_ptr<SecondTest> dead_base = std::move(kept);
+    expect("nullptr through an expired virtual base",
+           !dead_ref.hashkey() && !dead_base.hashkey() &&
+               !dead_base.alive() && dead_base._state());
+}
+
+void ProxyVectorTest() {
+    std::vector<proxy::proxy_ptr<int>> owners;
+    proxy::proxy_vector<int> list;
+    for (int i = 0; i < 200; i++) {
+        owners.push_back(proxy::make_proxy<int>(i));
+        list.push_back(owners.back());
+    }
+    // the dead ones span a full word and the partial last one
+    for (int i = 0; i < 200; i++)
+        if (i % 3 == 0 || (i >= 64 && i < 128))
+            owners[i].proxy_delete();
+
+    auto visited = std::distance(list.begin(), list.end());
+    expect("200 visited before the refresh", visited == 200);
+
+    const auto alive = list.refresh();
+    visited = 0;
+    for (auto& elem : list)
+        visited += elem.alive();
+    expect("90 90 90",
+           alive == 90 && visited == 90 && list.alive_count() == 90);
+
+    const auto dropped = list.erase_expired();
+    bool ordered = true;
+    for (size_t i = 1; i < list.size(); i++)
+        ordered = ordered && *list[i - 1] < *list[i];
+    expect("110 dropped, 90 left in order",
+           dropped == 110 && list.size() == 90 && ordered);
+
+    // the tick walking the list refreshes it, the compaction reads no block
+    owners[2].proxy_delete();
+    int sum = 0;
+    const auto walked =
+        list.for_each_alive([&](int& value) { sum += value; });
+    expect("89 walked, 1 dropped",
+           walked == 89 && list.erase_expired() == 1 && sum > 0);
+
+    owners[1].proxy_delete();
+    list.erase_unordered(list.begin().index());
+    list.push_back(proxy::make_proxy<int>(-1));
+    list.push_back(owners[0]);
+    const auto slots = list.size();
+    const auto refreshed = list.refresh();
+    expect("90 slots, 89 alive and 1 dropped",
+           slots == 90 && refreshed == 89 && list.erase_expired() == 1);
+}
+
+void AlgorithmTest() {
+    std::vector<proxy::proxy_ptr<int>> list;
+    for (int i = 0; i < 100; i++)
+        list.push_back(proxy::make_proxy<int>(i));
+    for (int i = 0; i < 100; i += 4)
+        list[i].proxy_delete();
+
+    int sum = 0;
+    const auto walked = proxy::for_each_alive(
+        list.begin(), list.end(), [&](int& value) { sum += value; });
+    expect("75 walked summing 3750",
+           walked == 75 && sum == 3750 &&
+               proxy::count_alive(list.begin(), list.end(), {0}) == 75);
+
+    auto end = proxy::partition_alive(list.begin(), list.end(),
+                                      {proxy::proxy_prefetch{2, true}});
+    bool ordered = std::is_sorted(
+        list.begin(), end, [](auto& a, auto& b) { return *a < *b; });
+    const auto expired = std::count_if(
+        end, list.end(), [](auto& ptr) { return ptr.expired(); });
+    expect("75 alive in order, 25 expired after",
+           std::distance(list.begin(), end) == 75 && ordered &&
+               expired == 25);
+    list.erase(end, list.end());
+
+    // the workers pin the objects while a thread deletes them
+    std::vector<proxy::proxy_ptr<int, proxy::proxy_atomic>> shared;
+    for (int i = 0; i < 10000; i++)
+        shared.push_back(proxy::make_proxy_atomic<int>(1));
+    proxy::proxy_thread_pool pool(4);
+    std::atomic<int> total{0};
+    std::thread deleter([&] {
+        for (int i = 0; i < 10000; i += 2)
+            shared[i].proxy_delete();
+    });
+    const auto visited =
+        proxy::for_each_alive(pool, shared.begin(), shared.end(),
+                              [&](int& value) { total += value; });
+    deleter.join();
+    // how many the workers visited before the deleter depends on the race
+    std::cout << visited << " visited" << std::endl;
+    expect("4 threads, the visits counted, 5000 alive",
+           pool.size() == 4 && visited >= 5000 &&
+               int(visited) == total &&
+               proxy::count_alive(pool, shared.begin(), shared.end()) == 5000);
+    for (auto& ptr : shared)
+        ptr.proxy_delete();
+    for (auto& ptr : list)
+        ptr.proxy_delete();
+}
+
 void RawMemoryTest() {
     proxy::proxy_ptr<RawMemoryClass> proxy;
 
@@ -446,8 +1556,36 @@ int main() {
     // LinkedRefTest();
     RawMemoryTest();
 
-    std::cout << "All tests completed." << std::endl;
+    // the tests checking their results, main() fails when one doesn't hold
+    MakeProxyTest();
+    ForwardingTest();
+    PoolTest();
+    PinTest();
+    EpochTest();
+    BiasedTest();
+    DeferredDeleteTest();
+    DeletionGuardTest();
+    TransparentHashTest();
+    FlatMapTest();
+    MoveTest();
+    RefTest();
+    ExpireHookTest();
+    LazyParentBaseTest();
+    IntrusiveTest();
+    HandleTest();
+    DomainTest();
+    StatsTest();
+    TraceTest();
+    Ptr32Test();
+    AliasingTest();
+    ProxyVectorTest();
+    AlgorithmTest();
+
+    std::cout << "All tests completed, " << failed_checks
+              << " checks failed." << std::endl;
+#ifndef PROXY_PTR_TEST_NO_PAUSE
     std::getchar();
     std::getchar();
-    return 0;
+#endif
+    return failed_checks ? 1 : 0;
 }